@@ -6,6 +6,10 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 using u8 = uint8_t;
 using u16 = uint16_t;
 using u32 = uint32_t;
@@ -51,22 +55,38 @@ struct Arena {
     usize capacity;
     usize position;
     ptr<void> memory;
+    // How memory goes back, free when null
+    func<void, ptr<void>, usize> release;
 
     static auto create(usize n) -> Arena {
         auto mem = malloc(n);
         assert(mem != NULL);
 
-        return { n, 0, mem };
+        return { n, 0, mem, nullptr };
     }
 
     auto destroy() -> void {
-        free(memory);
+        if (release != nullptr)
+            release(memory, capacity);
+        else
+            free(memory);
     }
 
     auto end() -> ptr<void> {
         return static_cast<ptr<char>>(memory) + position;
     }
 
+    // View over n bytes of this arena, released along with it
+    auto carve(usize n) -> Arena {
+        assert(position + n <= capacity);
+
+        auto sub = Arena { n, 0, end(), nullptr };
+
+        position += n;
+
+        return sub;
+    }
+
     template <typename T>
     auto align() -> void {
         if (position % alignof(T) != 0)
@@ -103,6 +123,67 @@ struct Arena {
     }
 };
 
+// Arena handed out to threads in chunks claimed with one atomic add
+struct Shared_Arena {
+    Arena arena;
+    usize chunk;
+
+    static auto create(usize n, usize chunk = 1 << 20) -> Shared_Arena {
+        // malloc only promises 16 bytes, chunks start on a cache line
+        auto arena = Arena::create(n + 63);
+        arena.position = (64 - reinterpret_cast<usize>(arena.memory) % 64) % 64;
+
+        return { arena, chunk };
+    }
+
+    auto destroy() -> void {
+        arena.destroy();
+    }
+
+    auto grab(usize n) -> Arena {
+        // Whole cache lines, so neighbouring chunks never share one
+        n = (n + 63) / 64 * 64;
+
+        auto start = __atomic_fetch_add(&arena.position, n, __ATOMIC_RELAXED);
+
+        assert(start + n <= arena.capacity);
+
+        return { n, 0, static_cast<ptr<char>>(arena.memory) + start, nullptr };
+    }
+};
+
+// Per-thread side of a Shared_Arena, bump allocates inside its own chunk
+struct Local_Arena {
+    ptr<Shared_Arena> shared;
+    Arena current;
+
+    static auto create(ptr<Shared_Arena> shared) -> Local_Arena {
+        return { shared, shared->grab(shared->chunk) };
+    }
+
+    // Moves to a fresh chunk unless n bytes aligned to a still fit
+    auto reserve(usize n, usize a) -> void {
+        if (current.position + a + n < current.capacity)
+            return;
+
+        current = shared->grab(n + a > shared->chunk ? n + a + 1 : shared->chunk);
+    }
+
+    template <typename T, typename ...A>
+    auto make(A... args) -> ptr<T> {
+        reserve(sizeof(T), alignof(T));
+
+        return current.make<T>(args...);
+    }
+
+    template <typename T, typename ...A>
+    auto allocate(usize n = 1, A... args) -> ptr<T> {
+        reserve(sizeof(T) * n, alignof(T));
+
+        return current.allocate<T>(n, args...);
+    }
+};
+
 template <typename T>
 struct Container {
     usize length;
@@ -367,231 +448,2814 @@ struct Vector_Builder {
     }
 };
 
-struct String {
-    ptr<imm<char>> data;
+template <usize I, typename T, typename ...R>
+struct Nth_Type {
+    using type = typename Nth_Type<I - 1, R...>::type;
+};
+
+template <typename T, typename ...R>
+struct Nth_Type<0, T, R...> {
+    using type = T;
+};
+
+template <typename A, typename B>
+struct Same_Type {
+    static constexpr bool value = false;
+};
+
+template <typename A>
+struct Same_Type<A, A> {
+    static constexpr bool value = true;
+};
+
+// One arena-backed column per field, rows are indices across columns
+template <typename ...F>
+struct Soa_Vector {
+    template <usize I>
+    using Field = typename Nth_Type<I, F...>::type;
+
+    usize tail;
     usize length;
+    buf<ptr<void>, sizeof...(F)> columns;
 
-    static auto create() -> String {
+    static auto create() -> Soa_Vector<F...> {
         return {};
     }
 
-    static auto create(ptr<imm<char>> s) -> String {
-        return { s, strlen(s) };
+    static auto create(ptr<Arena> arena, usize n) -> Soa_Vector<F...> {
+        auto vector = Soa_Vector::create();
+        vector.reserve(arena, n);
+        return vector;
     }
 
-    static auto create(ptr<imm<char>> s, usize n) -> String {
-        return { s, n };
+    auto reserve(ptr<Arena> arena, usize n) -> void {
+        assert(columns[0] == nullptr);
+
+        usize i = 0;
+        ((columns[i++] = arena->allocate<F>(n)), ...);
+
+        length = n;
     }
 
-    auto operator==(String other) -> bool {
-        if (length != other.length)
-            return false;
+    template <usize I>
+    auto column() -> ptr<Field<I>> {
+        return static_cast<ptr<Field<I>>>(columns[I]);
+    }
 
-        return memcmp(data, other.data, length) == 0;
+    template <usize I>
+    auto view() -> Container<Field<I>> {
+        return { length, tail, column<I>() };
     }
 
-    auto operator==(ptr<imm<char>> s) -> bool {
-        auto other = String::create(s);
+    template <usize I>
+    auto get(usize n) -> ref<Field<I>> {
+        return column<I>()[n];
+    }
 
-        return *this == other;
+    template <usize I = 0, typename H, typename ...R>
+    auto put(H value, R... rest) -> void {
+        column<I>()[tail] = value;
+
+        if constexpr (sizeof...(rest) > 0)
+            put<I + 1>(rest...);
     }
 
-    auto append(ptr<Arena> arena, String other) -> String {
-        auto string = String::create();
+    auto append(F... values) -> void {
+        assert(tail < length);
 
-        string.length = length + other.length;
+        put(values...);
 
-        auto buffer = arena->allocate<char>(string.length);
+        ++tail;
+    }
 
-        memcpy(buffer, data, length);
-        memcpy(buffer + length, other.data, other.length);
+    auto size() -> usize {
+        return length;
+    }
+};
 
-        string.data = buffer;
+struct Set_Bits {
+    ptr<u64> words;
+    usize count;
+    usize index;
+    u64 word;
 
-        return string;
+    auto advance() -> void {
+        while (word == 0 && index < count && ++index < count)
+            word = words[index];
     }
 
-    auto split(ptr<Arena> arena, char separator) -> Vector<String> {
-        auto strings = Vector_Builder<String>::create(arena);
+    auto operator*() -> usize {
+        return index * 64 + static_cast<usize>(__builtin_ctzll(word));
+    }
 
-        usize position = 0;
+    auto operator++() -> ref<Set_Bits> {
+        word &= word - 1;
+        advance();
+        return *this;
+    }
 
-        for (usize i = 0; i < length; ++i) {
-            if (data[i] == separator) {
-                strings.put(data + position, i - position);
-                position = i + 1;
-            }
+    auto operator!=(ref<Set_Bits> other) -> bool {
+        return index != other.index || word != other.word;
+    }
 
-            if (i + 1 == length)
-                strings.put(data + position, length - position);
-        }
+    auto begin() -> Set_Bits {
+        auto it = *this;
+        it.advance();
+        return it;
+    }
 
-        return strings.result;
+    auto end() -> Set_Bits {
+        return { words, count, count, 0 };
     }
+};
 
-    auto join(ptr<Arena> arena, Container<String> strings) -> String {
-        auto string = String::create();
+// Non-owning run of bits, bits past length are kept clear
+struct Bit_Vector {
+    usize length;
+    ptr<u64> words;
 
-        for (auto it: strings) {
-            string.length += it.length + length;
-        }
+    static auto create(ptr<Arena> arena, usize n) -> Bit_Vector {
+        auto bits = Bit_Vector { n, arena->allocate<u64>((n + 63) / 64) };
+        bits.clear();
+        return bits;
+    }
 
-        string.length -= length;
+    auto size() -> usize {
+        return (length + 63) / 64;
+    }
 
-        auto buffer = arena->allocate<char>(string.length);
+    auto clear() -> void {
+        memset(reinterpret_cast<ptr<char>>(words), 0, size() * sizeof(u64));
+    }
 
-        usize position = 0;
+    auto set(usize i) -> void {
+        words[i / 64] |= u64(1) << (i % 64);
+    }
 
-        for (auto it: strings) {
-            memcpy(buffer + position, it.data, it.length);
-            position += it.length;
+    auto reset(usize i) -> void {
+        words[i / 64] &= ~(u64(1) << (i % 64));
+    }
 
-            if (position < string.length) {
-                // Also copy separator
-                memcpy(buffer + position, data, length);
-                position += length;
-            }
-        }
+    auto assign(usize i, bool value) -> void {
+        words[i / 64] = (words[i / 64] & ~(u64(1) << (i % 64))) | (u64(value) << (i % 64));
+    }
 
-        string.data = buffer;
+    auto test(usize i) -> bool {
+        return (words[i / 64] >> (i % 64)) & 1;
+    }
 
-        return string;
+    auto operator&=(Bit_Vector other) -> ref<Bit_Vector> {
+        assert(length == other.length);
+
+        for (usize i = 0; i < size(); ++i)
+            words[i] &= other.words[i];
+
+        return *this;
     }
 
-    template <typename ...A>
-    auto format(ptr<Arena> arena, A... args) -> String {
-        auto cstr_arena = Arena::create(length + 1);
-        defer cleanup = [&cstr_arena](){ cstr_arena.destroy(); };
+    auto operator|=(Bit_Vector other) -> ref<Bit_Vector> {
+        assert(length == other.length);
 
-        auto format_cstr = cstr(&cstr_arena);
+        for (usize i = 0; i < size(); ++i)
+            words[i] |= other.words[i];
 
-        auto string = String::create();
+        return *this;
+    }
 
-        string.length = snprintf(NULL, 0, format_cstr, args...);
+    auto operator^=(Bit_Vector other) -> ref<Bit_Vector> {
+        assert(length == other.length);
 
-        auto buffer = arena->allocate<char>(string.length + 1);
+        for (usize i = 0; i < size(); ++i)
+            words[i] ^= other.words[i];
 
-        snprintf(buffer, string.length + 1, format_cstr, args...);
+        return *this;
+    }
 
-        string.data = buffer;
+    auto andnot(Bit_Vector other) -> ref<Bit_Vector> {
+        assert(length == other.length);
 
-        return string;
+        for (usize i = 0; i < size(); ++i)
+            words[i] &= ~other.words[i];
+
+        return *this;
     }
 
-    auto substring(String other) -> bool {
-        if (other.length > length)
-            return false;
+    auto flip() -> ref<Bit_Vector> {
+        for (usize i = 0; i < size(); ++i)
+            words[i] = ~words[i];
 
-        u32 match = 0;
+        if (length % 64 != 0)
+            words[size() - 1] &= (u64(1) << (length % 64)) - 1;
 
-        for (u32 i = 0; i < length; ++i) {
-            if (data[i] == other.data[match])
-                ++match;
-            else
-                match = data[i] == other.data[0] ? 1 : 0;
+        return *this;
+    }
 
-            if (match == other.length)
-                return true;
-        }
+    auto count() -> usize {
+        usize n = 0;
 
-        return false;
+        for (usize i = 0; i < size(); ++i)
+            n += static_cast<usize>(__builtin_popcountll(words[i]));
+
+        return n;
     }
 
-    auto right(usize n) -> String {
-        return { data + length - n, n };
+    auto ones() -> Set_Bits {
+        return { words, size(), 0, size() > 0 ? words[0] : 0 };
     }
+};
 
-    auto left(usize n) -> String {
-        return { data, n };
+template <usize N>
+struct Bitset {
+    buf<u64, (N + 63) / 64> words;
+
+    static auto create() -> Bitset<N> {
+        return {};
     }
 
-    auto chop_right(usize n) -> String {
-        return { data, length - n };
+    auto view() -> Bit_Vector {
+        return { N, words };
     }
 
-    auto chop_left(usize n) -> String {
-        return { data + n, length - n };
+    auto set(usize i) -> void {
+        view().set(i);
     }
-    
-    auto cstr(ptr<Arena> arena) -> ptr<imm<char>> {
-        auto s = arena->allocate<char>(length + 1);
 
-        memcpy(s, data, length);
+    auto reset(usize i) -> void {
+        view().reset(i);
+    }
 
-        s[length] = '\0';
+    auto test(usize i) -> bool {
+        return view().test(i);
+    }
 
-        return s;
+    auto operator&=(ref<Bitset<N>> other) -> ref<Bitset<N>> {
+        view() &= other.view();
+        return *this;
     }
 
-    static auto from_file(ptr<Arena> arena, String path) -> String {
-        auto scratch = Arena::create(path.length + 1);
-        defer cleanup = [&scratch](){ scratch.destroy(); };
+    auto operator|=(ref<Bitset<N>> other) -> ref<Bitset<N>> {
+        view() |= other.view();
+        return *this;
+    }
 
-        auto path_cstr = path.cstr(&scratch);
+    auto operator^=(ref<Bitset<N>> other) -> ref<Bitset<N>> {
+        view() ^= other.view();
+        return *this;
+    }
 
-        auto file = fopen(path_cstr, "rb");
+    auto andnot(ref<Bitset<N>> other) -> ref<Bitset<N>> {
+        view().andnot(other.view());
+        return *this;
+    }
 
-        assert(file != NULL);
+    auto count() -> usize {
+        return view().count();
+    }
 
-        assert(fseek(file, 0, SEEK_END) >= 0);
+    auto ones() -> Set_Bits {
+        return view().ones();
+    }
+};
 
-        auto string = String::create();
+// Ones before every 512 bit block, rank reads one entry and at most 8 words.
+// Every 512th one is sampled so select only searches between two samples
+struct Rank_Index {
+    static constexpr usize block = 8;
 
-        string.length = ftell(file);
+    Bit_Vector bits;
+    usize total;
+    ptr<usize> ranks;
+    ptr<usize> samples;
 
-        assert(fseek(file, 0, SEEK_SET) >= 0);
+    static auto create(ptr<Arena> arena, Bit_Vector bits) -> Rank_Index {
+        auto blocks = (bits.size() + block - 1) / block;
+        auto index = Rank_Index { bits, 0, arena->allocate<usize>(blocks + 1), nullptr };
 
-        auto buffer = arena->allocate<char>(string.length);
+        for (usize b = 0; b < blocks; ++b) {
+            index.ranks[b] = index.total;
 
-        fread(buffer, 1, string.length, file);
+            for (usize w = b * block; w < (b + 1) * block && w < bits.size(); ++w)
+                index.total += static_cast<usize>(__builtin_popcountll(bits.words[w]));
+        }
 
-        assert(ferror(file) == 0);
+        index.ranks[blocks] = index.total;
+        index.samples = arena->allocate<usize>(index.total / 512 + 1);
 
-        fclose(file);
+        usize b = 0;
 
-        string.data = buffer;
+        for (usize k = 0; k <= index.total / 512; ++k) {
+            while (b + 1 < blocks && index.ranks[b + 1] <= k * 512)
+                ++b;
 
-        return string;
+            index.samples[k] = b;
+        }
+
+        return index;
+    }
+
+    // Ones in [0, i)
+    auto rank(usize i) -> usize {
+        auto w = i / 64;
+        auto n = ranks[w / block];
+
+        for (auto j = w / block * block; j < w; ++j)
+            n += static_cast<usize>(__builtin_popcountll(bits.words[j]));
+
+        if (i % 64 != 0)
+            n += static_cast<usize>(__builtin_popcountll(bits.words[w] << (64 - i % 64)));
+
+        return n;
+    }
+
+    // Position of the one with rank k
+    auto select(usize k) -> usize {
+        assert(k < total);
+
+        auto low = samples[k / 512];
+        auto high = k / 512 + 1 <= total / 512 ? samples[k / 512 + 1] : (bits.size() + block - 1) / block - 1;
+
+        while (low < high) {
+            auto mid = low + (high - low + 1) / 2;
+
+            if (ranks[mid] <= k)
+                low = mid;
+            else
+                high = mid - 1;
+        }
+
+        k -= ranks[low];
+
+        for (auto w = low * block;; ++w) {
+            auto word = bits.words[w];
+            auto n = static_cast<usize>(__builtin_popcountll(word));
+
+            if (k < n) {
+                for (; k > 0; --k)
+                    word &= word - 1;
+
+                return w * 64 + static_cast<usize>(__builtin_ctzll(word));
+            }
+
+            k -= n;
+        }
     }
 };
 
-struct String_Builder {
-    ptr<Arena> arena;
-    ptr<char> end;
-    String result;
+struct Spinlock {
+    bool held;
 
-    static auto create(ptr<Arena> a) -> String_Builder {
-        auto start = static_cast<ptr<char>>(a->end());
+    static auto create() -> Spinlock {
+        return {};
+    }
 
-        return { a, start, { start, 0 } };
+    auto lock() -> void {
+        while (__atomic_test_and_set(&held, __ATOMIC_ACQUIRE))
+            while (__atomic_load_n(&held, __ATOMIC_RELAXED)) {}
     }
 
-    auto grow(usize n) -> void {
-        result.length += n;
-        end += n;
+    auto unlock() -> void {
+        __atomic_clear(&held, __ATOMIC_RELEASE);
     }
+};
 
-    auto push(String string) -> void {
-        auto space = arena->allocate<char>(string.length);
+template <typename T>
+struct Pool {
+    union Slot {
+        ptr<Slot> next;
+        alignas(T) buf<char, sizeof(T)> object;
+    };
 
-        assert(end == space);
+    ptr<Arena> arena;
+    usize slab;
+    ptr<Slot> free;
+    ptr<Slot> cursor;
+    ptr<Slot> limit;
+    Spinlock lock;
 
-        memcpy(space, string.data, string.length);
+    static auto create(ptr<Arena> arena, usize slab = 64) -> Pool<T> {
+        assert(slab > 0);
 
-        grow(string.length);
+        return { arena, slab, nullptr, nullptr, nullptr, Spinlock::create() };
+    }
+
+    // Slots are carved from the arena a slab at a time and never returned to it
+    auto slot() -> ptr<Slot> {
+        if (free != nullptr) {
+            auto s = free;
+            free = s->next;
+            return s;
+        }
+
+        if (cursor == limit) {
+            arena->align<Slot>();
+
+            assert(arena->position + sizeof(Slot) * slab <= arena->capacity);
+
+            cursor = arena->allocate<Slot>(slab);
+            limit = cursor + slab;
+        }
+
+        return cursor++;
     }
 
     template <typename ...A>
-    auto append(A... args) -> void {
-        (push(args), ...);
+    auto make(A... args) -> ptr<T> {
+        return new(slot()->object) T{args...};
     }
 
-    auto put(char c) -> void {
-        auto space = arena->make<char>(c);
+    auto release(ptr<T> object) -> void {
+        object->~T();
+
+        auto s = reinterpret_cast<ptr<Slot>>(object);
+        s->next = free;
+        free = s;
+    }
+
+    // Batch transfers used by Pool_Cache, safe to call from several threads
+    auto take(usize n) -> ptr<Slot> {
+        lock.lock();
+
+        ptr<Slot> list = nullptr;
+
+        for (usize i = 0; i < n; ++i) {
+            auto s = slot();
+            s->next = list;
+            list = s;
+        }
+
+        lock.unlock();
+
+        return list;
+    }
+
+    auto give(ptr<Slot> first, ptr<Slot> last) -> void {
+        lock.lock();
+
+        last->next = free;
+        free = first;
+
+        lock.unlock();
+    }
+};
+
+// Per-thread front for a shared Pool, only touches the pool once per batch
+template <typename T>
+struct Pool_Cache {
+    using Slot = typename Pool<T>::Slot;
+
+    ptr<Pool<T>> pool;
+    usize batch;
+    usize count;
+    ptr<Slot> free;
+
+    static auto create(ptr<Pool<T>> pool, usize batch = 32) -> Pool_Cache<T> {
+        assert(batch > 0);
+
+        return { pool, batch, 0, nullptr };
+    }
+
+    template <typename ...A>
+    auto make(A... args) -> ptr<T> {
+        if (free == nullptr) {
+            free = pool->take(batch);
+            count = batch;
+        }
+
+        auto s = free;
+        free = s->next;
+        --count;
+
+        return new(s->object) T{args...};
+    }
+
+    auto release(ptr<T> object) -> void {
+        object->~T();
+
+        auto s = reinterpret_cast<ptr<Slot>>(object);
+        s->next = free;
+        free = s;
+
+        if (++count >= batch * 2)
+            flush(batch);
+    }
+
+    auto flush(usize n) -> void {
+        if (n > count)
+            n = count;
+
+        if (n == 0)
+            return;
+
+        auto first = free;
+        auto last = first;
+
+        for (usize i = 1; i < n; ++i)
+            last = last->next;
+
+        free = last->next;
+        count -= n;
+
+        pool->give(first, last);
+    }
+
+    auto destroy() -> void {
+        flush(count);
+    }
+};
+
+struct String {
+    ptr<imm<char>> data;
+    usize length;
+
+    static auto create() -> String {
+        return {};
+    }
+
+    static auto create(ptr<imm<char>> s) -> String {
+        return { s, strlen(s) };
+    }
+
+    static auto create(ptr<imm<char>> s, usize n) -> String {
+        return { s, n };
+    }
+
+    auto operator==(String other) -> bool {
+        if (length != other.length)
+            return false;
+
+        return memcmp(data, other.data, length) == 0;
+    }
+
+    auto operator==(ptr<imm<char>> s) -> bool {
+        auto other = String::create(s);
+
+        return *this == other;
+    }
+
+    auto compare(String other) -> i32 {
+        auto n = length < other.length ? length : other.length;
+
+        for (usize i = 0; i < n; ++i) {
+            auto a = static_cast<u8>(data[i]);
+            auto b = static_cast<u8>(other.data[i]);
+
+            if (a != b)
+                return a < b ? -1 : 1;
+        }
+
+        return length == other.length ? 0 : (length < other.length ? -1 : 1);
+    }
+
+    auto operator<(String other) -> bool {
+        return compare(other) < 0;
+    }
+
+    // Index of the first occurrence of other, or length when there is none
+    auto find(String other) -> usize {
+        if (other.length == 0)
+            return 0;
+
+        for (usize i = 0; i + other.length <= length; ++i)
+            if (data[i] == other.data[0] && memcmp(data + i, other.data, other.length) == 0)
+                return i;
+
+        return length;
+    }
+
+    // FNV-1a
+    auto hash() -> u64 {
+        u64 h = 14695981039346656037ull;
+
+        for (usize i = 0; i < length; ++i) {
+            h ^= static_cast<u8>(data[i]);
+            h *= 1099511628211ull;
+        }
+
+        return h;
+    }
+
+    auto append(ptr<Arena> arena, String other) -> String {
+        auto string = String::create();
+
+        string.length = length + other.length;
+
+        auto buffer = arena->allocate<char>(string.length);
+
+        memcpy(buffer, data, length);
+        memcpy(buffer + length, other.data, other.length);
+
+        string.data = buffer;
+
+        return string;
+    }
+
+    auto split(ptr<Arena> arena, char separator) -> Vector<String> {
+        auto strings = Vector_Builder<String>::create(arena);
+
+        usize position = 0;
+
+        for (usize i = 0; i < length; ++i) {
+            if (data[i] == separator) {
+                strings.put(data + position, i - position);
+                position = i + 1;
+            }
+
+            if (i + 1 == length)
+                strings.put(data + position, length - position);
+        }
+
+        return strings.result;
+    }
+
+    auto join(ptr<Arena> arena, Container<String> strings) -> String {
+        auto string = String::create();
+
+        for (auto it: strings) {
+            string.length += it.length + length;
+        }
+
+        string.length -= length;
+
+        auto buffer = arena->allocate<char>(string.length);
+
+        usize position = 0;
+
+        for (auto it: strings) {
+            memcpy(buffer + position, it.data, it.length);
+            position += it.length;
+
+            if (position < string.length) {
+                // Also copy separator
+                memcpy(buffer + position, data, length);
+                position += length;
+            }
+        }
+
+        string.data = buffer;
+
+        return string;
+    }
+
+    template <typename ...A>
+    auto format(ptr<Arena> arena, A... args) -> String {
+        auto cstr_arena = Arena::create(length + 1);
+        defer cleanup = [&cstr_arena](){ cstr_arena.destroy(); };
+
+        auto format_cstr = cstr(&cstr_arena);
+
+        auto string = String::create();
+
+        string.length = snprintf(NULL, 0, format_cstr, args...);
+
+        auto buffer = arena->allocate<char>(string.length + 1);
+
+        snprintf(buffer, string.length + 1, format_cstr, args...);
+
+        string.data = buffer;
+
+        return string;
+    }
+
+    auto substring(String other) -> bool {
+        if (other.length > length)
+            return false;
+
+        u32 match = 0;
+
+        for (u32 i = 0; i < length; ++i) {
+            if (data[i] == other.data[match])
+                ++match;
+            else
+                match = data[i] == other.data[0] ? 1 : 0;
+
+            if (match == other.length)
+                return true;
+        }
+
+        return false;
+    }
+
+    auto right(usize n) -> String {
+        return { data + length - n, n };
+    }
+
+    auto left(usize n) -> String {
+        return { data, n };
+    }
+
+    auto chop_right(usize n) -> String {
+        return { data, length - n };
+    }
+
+    auto chop_left(usize n) -> String {
+        return { data + n, length - n };
+    }
+    
+    auto to_i64(ptr<i64> out) -> bool {
+        usize i = 0;
+        bool negative = false;
+
+        if (i < length && (data[i] == '-' || data[i] == '+'))
+            negative = data[i++] == '-';
+
+        if (i == length)
+            return false;
+
+        u64 value = 0;
+        u64 limit = negative ? 9223372036854775808ull : 9223372036854775807ull;
+
+        for (; i < length; ++i) {
+            if (data[i] < '0' || data[i] > '9')
+                return false;
+
+            auto digit = static_cast<u64>(data[i] - '0');
+
+            // Out of range for i64, so not an integer
+            if (value > (limit - digit) / 10)
+                return false;
+
+            value = value * 10 + digit;
+        }
+
+        *out = negative ? static_cast<i64>(0 - value) : static_cast<i64>(value);
+
+        return true;
+    }
+
+    auto to_f64(ptr<f64> out) -> bool {
+        static constexpr buf<f64, 23> powers = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        usize i = 0;
+        bool negative = false;
+
+        if (i < length && (data[i] == '-' || data[i] == '+'))
+            negative = data[i++] == '-';
+
+        u64 mantissa = 0;
+        i64 exponent = 0;
+        usize digits = 0;
+
+        for (; i < length && data[i] >= '0' && data[i] <= '9'; ++i, ++digits) {
+            if (mantissa < 1000000000000000000ull)
+                mantissa = mantissa * 10 + static_cast<u64>(data[i] - '0');
+            else
+                ++exponent;
+        }
+
+        if (i < length && data[i] == '.') {
+            for (++i; i < length && data[i] >= '0' && data[i] <= '9'; ++i, ++digits) {
+                if (mantissa < 1000000000000000000ull) {
+                    mantissa = mantissa * 10 + static_cast<u64>(data[i] - '0');
+                    --exponent;
+                }
+            }
+        }
+
+        if (digits == 0)
+            return false;
+
+        if (i < length && (data[i] == 'e' || data[i] == 'E')) {
+            bool negative_exponent = false;
+
+            if (++i < length && (data[i] == '-' || data[i] == '+'))
+                negative_exponent = data[i++] == '-';
+
+            if (i == length)
+                return false;
+
+            i64 e = 0;
+
+            // Anything past 400 is already 0 or infinity, so the exponent
+            // saturates there instead of overflowing
+            for (; i < length && data[i] >= '0' && data[i] <= '9'; ++i)
+                if (e < 400)
+                    e = e * 10 + (data[i] - '0');
+
+            exponent += negative_exponent ? -e : e;
+        }
+
+        if (i != length)
+            return false;
+
+        exponent = exponent < -400 ? -400 : exponent > 400 ? 400 : exponent;
+
+        auto value = static_cast<f64>(mantissa);
+
+        for (; exponent > 22; exponent -= 22)
+            value *= powers[22];
+
+        for (; exponent < -22; exponent += 22)
+            value /= powers[22];
+
+        value = exponent < 0 ? value / powers[-exponent] : value * powers[exponent];
+
+        *out = negative ? -value : value;
+
+        return true;
+    }
+
+    auto cstr(ptr<Arena> arena) -> ptr<imm<char>> {
+        auto s = arena->allocate<char>(length + 1);
+
+        memcpy(s, data, length);
+
+        s[length] = '\0';
+
+        return s;
+    }
+
+    static auto from_file(ptr<Arena> arena, String path) -> String {
+        auto scratch = Arena::create(path.length + 1);
+        defer cleanup = [&scratch](){ scratch.destroy(); };
+
+        auto path_cstr = path.cstr(&scratch);
+
+        auto file = fopen(path_cstr, "rb");
+
+        assert(file != NULL);
+
+        assert(fseek(file, 0, SEEK_END) >= 0);
+
+        auto string = String::create();
+
+        string.length = ftell(file);
+
+        assert(fseek(file, 0, SEEK_SET) >= 0);
+
+        auto buffer = arena->allocate<char>(string.length);
+
+        fread(buffer, 1, string.length, file);
+
+        assert(ferror(file) == 0);
+
+        fclose(file);
+
+        string.data = buffer;
+
+        return string;
+    }
+};
+
+struct String_Builder {
+    ptr<Arena> arena;
+    ptr<char> end;
+    String result;
+
+    static auto create(ptr<Arena> a) -> String_Builder {
+        auto start = static_cast<ptr<char>>(a->end());
+
+        return { a, start, { start, 0 } };
+    }
+
+    auto grow(usize n) -> void {
+        result.length += n;
+        end += n;
+    }
+
+    auto push(String string) -> void {
+        auto space = arena->allocate<char>(string.length);
+
+        assert(end == space);
+
+        memcpy(space, string.data, string.length);
+
+        grow(string.length);
+    }
+
+    template <typename ...A>
+    auto append(A... args) -> void {
+        (push(args), ...);
+    }
+
+    auto put(char c) -> void {
+        auto space = arena->make<char>(c);
+
+        assert(end == space);
+
+        grow(1);
+    }
+
+    // Appends n zeroed bytes and returns them for the caller to fill
+    auto extend(usize n) -> ptr<char> {
+        assert(arena->position + n <= arena->capacity);
+
+        auto space = arena->allocate<char>(n);
 
         assert(end == space);
 
-        grow(1);
+        memset(space, 0, n);
+        grow(n);
+
+        return space;
+    }
+};
+
+// Offset from its own address, so a packed buffer can be mapped anywhere
+template <typename T>
+struct Rel {
+    i64 offset;
+
+    auto get() -> ptr<T> {
+        if (offset == 0)
+            return nullptr;
+
+        return reinterpret_cast<ptr<T>>(reinterpret_cast<ptr<char>>(this) + offset);
+    }
+
+    auto set(ptr<T> target) -> void {
+        offset = target == nullptr
+            ? 0
+            : reinterpret_cast<ptr<imm<char>>>(target) - reinterpret_cast<ptr<imm<char>>>(this);
+    }
+};
+
+struct Packed_String {
+    Rel<imm<char>> data;
+    u64 length;
+
+    auto view() -> String {
+        return { data.get(), length };
+    }
+};
+
+template <typename T>
+struct Packed_Vector {
+    Rel<T> data;
+    u64 length;
+
+    auto view() -> Container<T> {
+        return { length, length, data.get() };
+    }
+
+    auto operator[] (usize n) -> ref<T> {
+        return data.get()[n];
+    }
+
+    auto begin() -> ptr<T> {
+        return data.get();
+    }
+
+    auto end() -> ptr<T> {
+        return data.get() + length;
+    }
+};
+
+struct Packed_Header {
+    u32 magic;
+    u32 version;
+    u64 size;
+    Rel<void> root;
+};
+
+// Lays out packed structures contiguously in an arena; objects are created
+// zeroed and in place, then linked with relative offsets
+struct Packer {
+    static constexpr u32 magic = 0x6b636170;
+    static constexpr u32 version = 1;
+    static constexpr usize alignment = 16;
+
+    String_Builder builder;
+    ptr<Packed_Header> header;
+
+    static auto create(ptr<Arena> arena) -> Packer {
+        arena->position += (alignment - reinterpret_cast<usize>(arena->end()) % alignment) % alignment;
+
+        auto packer = Packer { String_Builder::create(arena), nullptr };
+
+        packer.header = packer.make<Packed_Header>();
+        packer.header->magic = magic;
+        packer.header->version = version;
+
+        return packer;
+    }
+
+    template <typename T>
+    auto make(usize n = 1) -> ptr<T> {
+        static_assert(alignof(T) <= alignment);
+
+        auto padding = (alignof(T) - builder.result.length % alignof(T)) % alignof(T);
+
+        return reinterpret_cast<ptr<T>>(builder.extend(padding + sizeof(T) * n) + padding);
+    }
+
+    auto store(ref<Packed_String> field, String string) -> void {
+        auto chars = make<char>(string.length);
+
+        memcpy(chars, string.data, string.length);
+
+        field.data.set(chars);
+        field.length = string.length;
+    }
+
+    // Elements are left zeroed for the caller to fill
+    template <typename T>
+    auto store(ref<Packed_Vector<T>> field, usize n) -> ptr<T> {
+        auto items = make<T>(n);
+
+        field.data.set(items);
+        field.length = n;
+
+        return items;
+    }
+
+    // Copies plain data elements as they are
+    template <typename T>
+    auto store(ref<Packed_Vector<T>> field, Container<T> items) -> void {
+        auto space = store(field, items.tail);
+
+        memcpy(reinterpret_cast<ptr<char>>(space), reinterpret_cast<ptr<imm<char>>>(items.data), items.tail * sizeof(T));
+    }
+
+    template <typename T>
+    auto finish(ptr<T> root) -> String {
+        header->root.set(root);
+        header->size = builder.result.length;
+
+        return builder.result;
+    }
+};
+
+// Reads a packed buffer in place, the buffer must stay alive and unmodified
+template <typename T>
+auto unpack(String buffer) -> ptr<T> {
+    assert(buffer.length >= sizeof(Packed_Header));
+    assert(reinterpret_cast<usize>(buffer.data) % Packer::alignment == 0);
+
+    auto header = reinterpret_cast<ptr<Packed_Header>>(const_cast<ptr<char>>(buffer.data));
+
+    assert(header->magic == Packer::magic);
+    assert(header->version == Packer::version);
+    assert(header->size <= buffer.length);
+
+    auto root = static_cast<ptr<imm<char>>>(header->root.get());
+
+    assert(root >= buffer.data + sizeof(Packed_Header));
+    assert(root + sizeof(T) <= buffer.data + header->size);
+
+    return reinterpret_cast<ptr<T>>(const_cast<ptr<char>>(root));
+}
+
+// Fixed number of entries in one arena slab, keys copied into slots of
+// max_key bytes; the least recently referenced entry is evicted by CLOCK.
+// String values are copied into slots of max_value bytes that are reused
+// with their entry, so they stay valid until it is evicted or replaced.
+// Longer keys or values are not cached
+template <typename V>
+struct Cache {
+    struct Entry {
+        ptr<Entry> next;
+        u64 hash;
+        String key;
+        V value;
+        bool used;
+        bool referenced;
+    };
+
+    usize capacity;
+    usize max_key;
+    usize max_value;
+    usize count;
+    usize hand;
+    usize mask;
+    ptr<Entry> entries;
+    ptr<ptr<Entry>> buckets;
+    ptr<char> keys;
+    ptr<char> values;
+    u64 hits;
+    u64 misses;
+    u64 evictions;
+
+    static auto create(ptr<Arena> arena, usize capacity, usize max_key = 256, usize max_value = 4096) -> Cache<V> {
+        assert(capacity > 0);
+
+        usize size = 1;
+
+        while (size < capacity * 2)
+            size *= 2;
+
+        auto cache = Cache<V> {};
+
+        cache.capacity = capacity;
+        cache.max_key = max_key;
+        cache.max_value = max_value;
+        cache.mask = size - 1;
+        cache.entries = arena->allocate<Entry>(capacity);
+        cache.buckets = arena->allocate<ptr<Entry>>(size);
+        cache.keys = arena->allocate<char>(capacity * max_key);
+
+        if constexpr (Same_Type<V, String>::value)
+            cache.values = arena->allocate<char>(capacity * max_value);
+
+        memset(reinterpret_cast<ptr<char>>(cache.entries), 0, capacity * sizeof(Entry));
+        memset(reinterpret_cast<ptr<char>>(cache.buckets), 0, size * sizeof(ptr<Entry>));
+
+        return cache;
+    }
+
+    auto find(String key, u64 hash) -> ptr<ptr<Entry>> {
+        auto link = &buckets[hash & mask];
+
+        while (*link != nullptr && ((*link)->hash != hash || !((*link)->key == key)))
+            link = &(*link)->next;
+
+        return link;
+    }
+
+    auto get(String key) -> ptr<V> {
+        auto entry = *find(key, key.hash());
+
+        if (entry == nullptr) {
+            ++misses;
+            return nullptr;
+        }
+
+        ++hits;
+        entry->referenced = true;
+
+        return &entry->value;
+    }
+
+    auto unlink(ptr<Entry> entry) -> void {
+        auto link = find(entry->key, entry->hash);
+
+        *link = entry->next;
+        entry->used = false;
+        --count;
+    }
+
+    // Sweeps the clock hand to a free slot, evicting on the way if full
+    auto slot() -> ptr<Entry> {
+        for (;;) {
+            auto entry = &entries[hand];
+            hand = (hand + 1) % capacity;
+
+            if (!entry->used)
+                return entry;
+
+            if (count < capacity)
+                continue;
+
+            if (entry->referenced) {
+                entry->referenced = false;
+                continue;
+            }
+
+            unlink(entry);
+            ++evictions;
+
+            return entry;
+        }
+    }
+
+    auto store(ptr<Entry> entry, V value) -> void {
+        if constexpr (Same_Type<V, String>::value) {
+            auto storage = values + (entry - entries) * max_value;
+
+            // value may already live in this slot
+            memmove(storage, value.data, value.length);
+            value = { storage, value.length };
+        }
+
+        entry->value = value;
+    }
+
+    // nullptr when key or value is too long to cache
+    auto put(String key, V value) -> ptr<V> {
+        if (key.length > max_key)
+            return nullptr;
+
+        if constexpr (Same_Type<V, String>::value)
+            if (value.length > max_value)
+                return nullptr;
+
+        auto hash = key.hash();
+        auto link = find(key, hash);
+
+        if (*link != nullptr) {
+            store(*link, value);
+            return &(*link)->value;
+        }
+
+        auto entry = slot();
+        auto storage = keys + (entry - entries) * max_key;
+
+        memcpy(storage, key.data, key.length);
+
+        *entry = { nullptr, hash, { storage, key.length }, value, true, false };
+        store(entry, value);
+
+        // Eviction may have reshaped the chain, look the bucket up again
+        link = find(key, hash);
+        *link = entry;
+        ++count;
+
+        return &entry->value;
+    }
+
+    auto remove(String key) -> bool {
+        auto entry = *find(key, key.hash());
+
+        if (entry == nullptr)
+            return false;
+
+        unlink(entry);
+
+        return true;
+    }
+
+    template <typename F>
+    auto fetch(String key, F load) -> V {
+        auto value = get(key);
+
+        if (value != nullptr)
+            return *value;
+
+        auto loaded = load();
+        auto stored = put(key, loaded);
+
+        return stored != nullptr ? *stored : loaded;
+    }
+};
+
+// N independently locked caches, picked by key hash. String values are
+// copied out into the given arena while the shard is locked
+template <typename V, usize N>
+struct Sharded_Cache {
+    buf<Cache<V>, N> shards;
+    buf<Spinlock, N> locks;
+
+    static auto create(ptr<Arena> arena, usize capacity, usize max_key = 256, usize max_value = 4096) -> Sharded_Cache<V, N> {
+        auto cache = Sharded_Cache<V, N> {};
+
+        for (usize i = 0; i < N; ++i)
+            cache.shards[i] = Cache<V>::create(arena, (capacity + N - 1) / N, max_key, max_value);
+
+        return cache;
+    }
+
+    auto shard(String key) -> usize {
+        return (key.hash() >> 32) % N;
+    }
+
+    auto get(String key, ptr<V> out) -> bool {
+        // String values are copied out under the lock, they need an arena
+        static_assert(!Same_Type<V, String>::value);
+
+        return get(key, out, nullptr);
+    }
+
+    auto get(String key, ptr<V> out, ptr<Arena> copy) -> bool {
+        auto i = shard(key);
+
+        locks[i].lock();
+        auto value = shards[i].get(key);
+
+        if (value != nullptr)
+            *out = *value;
+
+        if constexpr (Same_Type<V, String>::value) {
+            assert(copy != nullptr);
+
+            if (value != nullptr) {
+                auto bytes = copy->allocate<char>(value->length);
+                memcpy(bytes, value->data, value->length);
+                *out = { bytes, value->length };
+            }
+        }
+
+        locks[i].unlock();
+
+        return value != nullptr;
+    }
+
+    auto put(String key, V value) -> void {
+        auto i = shard(key);
+
+        locks[i].lock();
+        shards[i].put(key, value);
+        locks[i].unlock();
+    }
+
+    // load runs outside the lock, concurrent misses may both load
+    template <typename F>
+    auto fetch(String key, F load) -> V {
+        static_assert(!Same_Type<V, String>::value);
+
+        return fetch(key, load, nullptr);
+    }
+
+    template <typename F>
+    auto fetch(String key, F load, ptr<Arena> copy) -> V {
+        V value;
+
+        if (get(key, &value, copy))
+            return value;
+
+        value = load();
+        put(key, value);
+
+        return value;
+    }
+
+    auto hits() -> u64 {
+        u64 n = 0;
+
+        for (usize i = 0; i < N; ++i)
+            n += __atomic_load_n(&shards[i].hits, __ATOMIC_RELAXED);
+
+        return n;
+    }
+
+    auto misses() -> u64 {
+        u64 n = 0;
+
+        for (usize i = 0; i < N; ++i)
+            n += __atomic_load_n(&shards[i].misses, __ATOMIC_RELAXED);
+
+        return n;
+    }
+
+    auto evictions() -> u64 {
+        u64 n = 0;
+
+        for (usize i = 0; i < N; ++i)
+            n += __atomic_load_n(&shards[i].evictions, __ATOMIC_RELAXED);
+
+        return n;
+    }
+};
+
+// Bit i is set when s[i] == c, sixteen bytes per compare where SSE2 is available
+auto byte_mask(ptr<imm<char>> s, usize n, char c) -> u64 {
+    u64 mask = 0;
+    usize i = 0;
+
+#ifdef __SSE2__
+    auto needle = _mm_set1_epi8(c);
+
+    for (; i + 16 <= n; i += 16) {
+        // Spelled out, ptr<> would drop the vector attributes of __m128i
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+        auto bits = static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+
+        mask |= static_cast<u64>(bits) << i;
+    }
+#endif
+
+    for (; i < n; ++i)
+        mask |= static_cast<u64>(s[i] == c) << i;
+
+    return mask;
+}
+
+auto prefix_xor(u64 x) -> u64 {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+
+    return x;
+}
+
+// Walks separators and newlines outside quotes 64 bytes at a time
+struct Csv_Scanner {
+    String text;
+    char separator;
+    bool quoted;
+
+    static auto create(String text, char separator, bool quoted = false) -> Csv_Scanner {
+        return { text, separator, quoted };
+    }
+
+    // callback(begin, end, end_of_row) -> bool, returning false stops the scan
+    template <typename F>
+    auto scan(F callback) -> usize {
+        usize start = 0;
+
+        for (usize base = 0; base < text.length; base += 64) {
+            auto n = text.length - base < 64 ? text.length - base : 64;
+            auto block = text.data + base;
+
+            auto inside = prefix_xor(byte_mask(block, n, '"'));
+
+            if (quoted)
+                inside = ~inside;
+
+            quoted = (inside >> (n - 1)) & 1;
+
+            auto structural = (byte_mask(block, n, separator) | byte_mask(block, n, '\n')) & ~inside;
+
+            while (structural != 0) {
+                auto i = base + static_cast<usize>(__builtin_ctzll(structural));
+                structural &= structural - 1;
+
+                if (!callback(start, i, text.data[i] == '\n'))
+                    return i + 1;
+
+                start = i + 1;
+            }
+        }
+
+        // A last row ending in an empty field still has that field
+        if (start < text.length || (start > 0 && text.data[start - 1] == separator))
+            callback(start, text.length, true);
+
+        return text.length;
+    }
+};
+
+auto csv_field(ptr<Arena> arena, String raw) -> String {
+    if (raw.length > 0 && raw.data[raw.length - 1] == '\r')
+        raw = raw.chop_right(1);
+
+    if (raw.length < 2 || raw.data[0] != '"')
+        return raw;
+
+    auto inner = raw.chop_left(1);
+
+    if (inner.data[inner.length - 1] == '"')
+        inner = inner.chop_right(1);
+
+    usize escapes = 0;
+
+    for (usize i = 0; i < inner.length; ++i)
+        escapes += inner.data[i] == '"';
+
+    if (escapes == 0)
+        return inner;
+
+    auto buffer = arena->allocate<char>(inner.length - escapes / 2);
+    usize n = 0;
+
+    for (usize i = 0; i < inner.length; ++i) {
+        buffer[n++] = inner.data[i];
+
+        if (inner.data[i] == '"' && i + 1 < inner.length && inner.data[i + 1] == '"')
+            ++i;
+    }
+
+    return { buffer, n };
+}
+
+enum struct Csv_Type: u8 { integer, real, text };
+
+struct Csv_Options {
+    char separator;
+    bool header;
+    usize sample;
+
+    static auto create() -> Csv_Options {
+        return { ',', true, 64 };
+    }
+};
+
+struct Csv_Column {
+    String name;
+    Csv_Type type;
+    ptr<void> data;
+
+    auto store(ptr<Arena> arena, usize row, String raw) -> void {
+        auto field = csv_field(arena, raw);
+
+        switch (type) {
+        case Csv_Type::integer: {
+            auto value = static_cast<ptr<i64>>(data) + row;
+
+            if (!field.to_i64(value))
+                *value = 0;
+        } break;
+        case Csv_Type::real: {
+            auto value = static_cast<ptr<f64>>(data) + row;
+
+            if (!field.to_f64(value))
+                *value = 0;
+        } break;
+        case Csv_Type::text:
+            static_cast<ptr<String>>(data)[row] = field;
+            break;
+        }
+    }
+};
+
+struct Csv_Table {
+    usize rows;
+    String body;
+    Csv_Options options;
+    Vector<Csv_Column> columns;
+
+    static auto create(ptr<Arena> arena, String text, Csv_Options options) -> Csv_Table {
+        auto table = Csv_Table::layout(arena, text, options);
+
+        table.infer();
+        table.reserve(arena, table.count(table.body, false));
+        table.rows = table.fill(arena, table.body, false, 0);
+
+        return table;
+    }
+
+    static auto create(ptr<Arena> arena, String text, Csv_Options options, Container<Csv_Type> types) -> Csv_Table {
+        auto table = Csv_Table::layout(arena, text, options);
+
+        assert(types.tail == table.columns.tail);
+
+        for (usize i = 0; i < types.tail; ++i)
+            table.columns[i].type = types[i];
+
+        table.reserve(arena, table.count(table.body, false));
+        table.rows = table.fill(arena, table.body, false, 0);
+
+        return table;
+    }
+
+    // Reads the first row for the column count and names
+    static auto layout(ptr<Arena> arena, String text, Csv_Options options) -> Csv_Table {
+        usize width = 0;
+
+        auto first = Csv_Scanner::create(text, options.separator).scan([&](usize, usize, bool last) {
+            ++width;
+            return !last;
+        });
+
+        auto table = Csv_Table { 0, options.header ? text.chop_left(first) : text, options, {} };
+
+        table.columns.reserve(arena, width);
+
+        Csv_Scanner::create(text, options.separator).scan([&](usize begin, usize end, bool last) {
+            auto name = options.header
+                ? csv_field(arena, { text.data + begin, end - begin })
+                : String::create();
+
+            table.columns.append({ name, Csv_Type::integer, nullptr });
+
+            return !last;
+        });
+
+        return table;
+    }
+
+    auto infer() -> void {
+        auto types = columns.begin();
+        usize sampled = 0;
+        usize column = 0;
+
+        Csv_Scanner::create(body, options.separator).scan([&](usize begin, usize end, bool last) {
+            auto field = String::create(body.data + begin, end - begin);
+
+            if (field.length > 0 && field.data[field.length - 1] == '\r')
+                field = field.chop_right(1);
+
+            if (last && column == 0 && blank(field))
+                return true;
+
+            // Typed by the quoted contents, as store() sees them
+            if (field.length > 0 && field.data[0] == '"') {
+                field = field.chop_left(1);
+
+                if (field.length > 0 && field.data[field.length - 1] == '"')
+                    field = field.chop_right(1);
+            }
+
+            if (column < columns.tail && field.length > 0) {
+                i64 i;
+                f64 f;
+
+                if (types[column].type == Csv_Type::integer && !field.to_i64(&i))
+                    types[column].type = Csv_Type::real;
+
+                if (types[column].type == Csv_Type::real && !field.to_f64(&f))
+                    types[column].type = Csv_Type::text;
+            }
+
+            ++column;
+
+            if (last) {
+                ++sampled;
+                column = 0;
+            }
+
+            return sampled < options.sample;
+        });
+    }
+
+    auto reserve(ptr<Arena> arena, usize n) -> void {
+        for (auto &it: columns) {
+            switch (it.type) {
+            case Csv_Type::integer: it.data = arena->allocate<i64>(n); break;
+            case Csv_Type::real: it.data = arena->allocate<f64>(n); break;
+            case Csv_Type::text: it.data = arena->allocate<String>(n); break;
+            }
+        }
+    }
+
+    static auto blank(String raw) -> bool {
+        return raw.length == 0 || (raw.length == 1 && raw.data[0] == '\r');
+    }
+
+    // Non blank rows in text, starting inside quotes when quoted is set
+    auto count(String text, bool quoted) -> usize {
+        usize n = 0;
+        usize column = 0;
+
+        Csv_Scanner::create(text, options.separator, quoted).scan([&](usize begin, usize end, bool last) {
+            if (last && column == 0 && blank({ text.data + begin, end - begin }))
+                return true;
+
+            ++column;
+
+            if (last) {
+                ++n;
+                column = 0;
+            }
+
+            return true;
+        });
+
+        return n;
+    }
+
+    auto fill(ptr<Arena> arena, String text, bool quoted, usize row) -> usize {
+        usize column = 0;
+
+        Csv_Scanner::create(text, options.separator, quoted).scan([&](usize begin, usize end, bool last) {
+            auto raw = String::create(text.data + begin, end - begin);
+
+            if (last && column == 0 && blank(raw))
+                return true;
+
+            if (column < columns.tail)
+                columns[column].store(arena, row, raw);
+
+            ++column;
+
+            if (last) {
+                for (; column < columns.tail; ++column)
+                    columns[column].store(arena, row, String::create());
+
+                ++row;
+                column = 0;
+            }
+
+            return true;
+        });
+
+        return row;
+    }
+
+    template <typename T>
+    auto column(usize n) -> Container<T> {
+        if constexpr (Same_Type<T, i64>::value)
+            assert(columns[n].type == Csv_Type::integer);
+        else if constexpr (Same_Type<T, f64>::value)
+            assert(columns[n].type == Csv_Type::real);
+        else
+            assert(columns[n].type == Csv_Type::text);
+
+        return { rows, rows, static_cast<ptr<T>>(columns[n].data) };
+    }
+};
+
+template <typename T>
+auto swap(ref<T> a, ref<T> b) -> void {
+    auto t = a;
+    a = b;
+    b = t;
+}
+
+template <typename T, typename F>
+auto insertion_sort(ptr<T> first, ptr<T> last, F less) -> void {
+    for (auto it = first + 1; it < last; ++it) {
+        auto value = *it;
+        auto hole = it;
+
+        for (; hole > first && less(value, hole[-1]); --hole)
+            *hole = hole[-1];
+
+        *hole = value;
+    }
+}
+
+// Gives up once more than limit elements were moved, for nearly sorted ranges
+template <typename T, typename F>
+auto partial_insertion_sort(ptr<T> first, ptr<T> last, F less, usize limit) -> bool {
+    usize moved = 0;
+
+    for (auto it = first + 1; it < last; ++it) {
+        auto value = *it;
+        auto hole = it;
+
+        for (; hole > first && less(value, hole[-1]); --hole)
+            *hole = hole[-1];
+
+        *hole = value;
+        moved += static_cast<usize>(it - hole);
+
+        if (moved > limit)
+            return false;
+    }
+
+    return true;
+}
+
+template <typename T, typename F>
+auto sift_down(ptr<T> heap, usize n, usize i, F less) -> void {
+    for (auto child = 2 * i + 1; child < n; child = 2 * i + 1) {
+        if (child + 1 < n && less(heap[child], heap[child + 1]))
+            ++child;
+
+        if (!less(heap[i], heap[child]))
+            return;
+
+        swap(heap[i], heap[child]);
+        i = child;
+    }
+}
+
+template <typename T, typename F>
+auto heap_sort(ptr<T> first, ptr<T> last, F less) -> void {
+    auto n = static_cast<usize>(last - first);
+
+    for (auto i = n / 2; i > 0; --i)
+        sift_down(first, n, i - 1, less);
+
+    for (auto i = n; i > 1; --i) {
+        swap(first[0], first[i - 1]);
+        sift_down(first, i - 1, 0, less);
+    }
+}
+
+template <typename T, typename F>
+auto sort3(ptr<T> a, ptr<T> b, ptr<T> c, F less) -> void {
+    if (less(*b, *a)) swap(*a, *b);
+    if (less(*c, *b)) swap(*b, *c);
+    if (less(*b, *a)) swap(*a, *b);
+}
+
+// Introsort with ninther pivots and a bailout to insertion sort on ranges
+// that partitioned without any swaps, in the spirit of pdqsort
+template <typename T, typename F>
+auto introsort(ptr<T> first, ptr<T> last, F less, usize depth) -> void {
+    while (last - first > 24) {
+        if (depth-- == 0) {
+            heap_sort(first, last, less);
+            return;
+        }
+
+        auto n = static_cast<usize>(last - first);
+        auto mid = first + n / 2;
+
+        if (n > 128) {
+            auto s = n / 8;
+            sort3(first, first + s, first + 2 * s, less);
+            sort3(mid - s, mid, mid + s, less);
+            sort3(last - 1 - 2 * s, last - 1 - s, last - 1, less);
+            sort3(first + s, mid, last - 1 - s, less);
+        } else {
+            sort3(first, mid, last - 1, less);
+        }
+
+        swap(*first, *mid);
+
+        auto pivot = *first;
+        auto i = first;
+        auto j = last;
+        bool swapped = false;
+
+        for (;;) {
+            while (less(*++i, pivot) && i < last - 1) {}
+            while (less(pivot, *--j)) {}
+
+            if (i >= j)
+                break;
+
+            swap(*i, *j);
+            swapped = true;
+        }
+
+        swap(*first, *j);
+
+        if (!swapped
+            && partial_insertion_sort(first, j, less, 8)
+            && partial_insertion_sort(j + 1, last, less, 8))
+            return;
+
+        // Recurse into the smaller side to bound stack depth
+        if (j - first < last - j) {
+            introsort(first, j, less, depth);
+            first = j + 1;
+        } else {
+            introsort(j + 1, last, less, depth);
+            last = j;
+        }
+    }
+
+    insertion_sort(first, last, less);
+}
+
+template <typename T, typename F>
+auto sort(Container<T> items, F less) -> void {
+    usize depth = 0;
+
+    for (auto n = items.tail; n > 1; n /= 2)
+        depth += 2;
+
+    if (items.tail > 1)
+        introsort(items.begin(), items.end(), less, depth);
+}
+
+template <typename T>
+auto sort(Container<T> items) -> void {
+    sort(items, [](ref<T> a, ref<T> b) { return a < b; });
+}
+
+// LSD radix sort on integer keys, scratch space is given back to the arena
+template <typename T>
+auto radix_sort(ptr<Arena> arena, Container<T> items) -> void {
+    static_assert(static_cast<T>(1) / 2 == 0, "radix_sort needs integer keys");
+
+    static constexpr u64 sign = static_cast<T>(-1) < 0 ? u64(1) << (sizeof(T) * 8 - 1) : 0;
+
+    auto n = items.tail;
+
+    if (n < 2)
+        return;
+    auto mark = arena->position;
+    defer restore = [arena, mark](){ arena->position = mark; };
+
+    auto key = [](T value) -> u64 {
+        return static_cast<u64>(value) ^ sign;
+    };
+
+    buf<buf<usize, 256>, sizeof(T)> counts;
+    memset(reinterpret_cast<ptr<char>>(counts), 0, sizeof(counts));
+
+    for (usize i = 0; i < n; ++i) {
+        auto k = key(items.data[i]);
+
+        for (usize d = 0; d < sizeof(T); ++d)
+            ++counts[d][(k >> (d * 8)) & 0xff];
+    }
+
+    auto src = items.data;
+    auto dst = arena->allocate<T>(n);
+
+    for (usize d = 0; d < sizeof(T); ++d) {
+        auto count = counts[d];
+
+        if (count[(key(src[0]) >> (d * 8)) & 0xff] == n)
+            continue;
+
+        usize offset = 0;
+
+        for (usize b = 0; b < 256; ++b) {
+            auto c = count[b];
+            count[b] = offset;
+            offset += c;
+        }
+
+        for (usize i = 0; i < n; ++i)
+            dst[count[(key(src[i]) >> (d * 8)) & 0xff]++] = src[i];
+
+        swap(src, dst);
+    }
+
+    if (src != items.data)
+        memcpy(reinterpret_cast<ptr<char>>(items.data), reinterpret_cast<ptr<imm<char>>>(src), n * sizeof(T));
+}
+
+// Each level keeps 4KB of counts on the stack, past max_levels the rest
+// is left to a comparison sort
+auto msd_radix_sort(ptr<String> items, ptr<String> scratch, usize n, usize depth, usize levels = 0) -> void {
+    static constexpr usize max_levels = 32;
+
+    auto byte = [&depth](String s) -> usize {
+        return s.length > depth ? static_cast<u8>(s.data[depth]) + 1 : 0;
+    };
+
+    auto suffix_less = [&depth](String a, String b) {
+        return a.chop_left(depth) < b.chop_left(depth);
+    };
+
+    buf<usize, 258> offsets;
+
+    for (;;) {
+        if (n < 32) {
+            insertion_sort(items, items + n, suffix_less);
+            return;
+        }
+
+        if (levels >= max_levels) {
+            sort(Container<String> { n, n, items }, suffix_less);
+            return;
+        }
+
+        memset(reinterpret_cast<ptr<char>>(offsets), 0, sizeof(offsets));
+
+        for (usize i = 0; i < n; ++i)
+            ++offsets[byte(items[i]) + 1];
+
+        // A byte shared by everything splits nothing, step over it in place
+        auto shared = byte(items[0]);
+
+        if (shared == 0 || offsets[shared + 1] != n)
+            break;
+
+        ++depth;
+    }
+
+    for (usize b = 1; b < 258; ++b)
+        offsets[b] += offsets[b - 1];
+
+    buf<usize, 258> starts;
+    memcpy(reinterpret_cast<ptr<char>>(starts), reinterpret_cast<ptr<imm<char>>>(offsets), sizeof(offsets));
+
+    for (usize i = 0; i < n; ++i)
+        scratch[offsets[byte(items[i])]++] = items[i];
+
+    memcpy(reinterpret_cast<ptr<char>>(items), reinterpret_cast<ptr<imm<char>>>(scratch), n * sizeof(String));
+
+    // Bucket 0 holds strings that end here and is already in order
+    for (usize b = 1; b < 257; ++b) {
+        auto size = starts[b + 1] - starts[b];
+
+        if (size > 1)
+            msd_radix_sort(items + starts[b], scratch, size, depth + 1, levels + 1);
+    }
+}
+
+// MSD radix sort on bytes, scratch space is given back to the arena
+auto radix_sort(ptr<Arena> arena, Container<String> items) -> void {
+    auto mark = arena->position;
+    defer restore = [arena, mark](){ arena->position = mark; };
+
+    msd_radix_sort(items.data, arena->allocate<String>(items.tail), items.tail, 0);
+}
+
+// Index of the first element not less than value
+template <typename T>
+auto lower_bound(Container<T> items, T value) -> usize {
+    usize low = 0;
+    usize high = items.tail;
+
+    while (low < high) {
+        auto mid = low + (high - low) / 2;
+
+        if (items.data[mid] < value)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+// Same result as lower_bound, the loop body compiles to a conditional move
+template <typename T>
+auto lower_bound_branchless(Container<T> items, T value) -> usize {
+    if (items.tail == 0)
+        return 0;
+
+    auto base = items.data;
+
+    for (auto n = items.tail; n > 1; n -= n / 2)
+        base = base[n / 2] < value ? base + n / 2 : base;
+
+    return static_cast<usize>(base - items.data) + (*base < value);
+}
+
+// Only named inside decltype to get at the type of an expression
+template <typename T>
+auto value_of() -> T;
+
+template <typename T>
+struct Container_Source {
+    using Item = T;
+
+    Container<T> items;
+
+    template <typename F>
+    auto run(F sink) -> void {
+        for (usize i = 0; i < items.tail; ++i)
+            if (!sink(items.data[i]))
+                return;
+    }
+};
+
+// Same pieces as String::split without building the Vector
+struct Split_Source {
+    using Item = String;
+
+    String text;
+    char separator;
+
+    template <typename F>
+    auto run(F sink) -> void {
+        usize position = 0;
+
+        for (usize i = 0; i < text.length; ++i) {
+            if (text.data[i] == separator) {
+                if (!sink(String::create(text.data + position, i - position)))
+                    return;
+
+                position = i + 1;
+            }
+
+            if (i + 1 == text.length)
+                sink(String::create(text.data + position, text.length - position));
+        }
+    }
+};
+
+// Adapts any reader with next(ptr<T>) -> bool
+template <typename R, typename T>
+struct Reader_Source {
+    using Item = T;
+
+    ptr<R> reader;
+
+    template <typename F>
+    auto run(F sink) -> void {
+        T item;
+
+        while (reader->next(&item))
+            if (!sink(item))
+                return;
+    }
+};
+
+template <typename S, typename M>
+struct Map_Stage {
+    using Item = decltype(value_of<M>()(value_of<typename S::Item>()));
+
+    S source;
+    M f;
+
+    template <typename F>
+    auto run(F sink) -> void {
+        source.run([&](typename S::Item item) {
+            return sink(f(item));
+        });
+    }
+};
+
+template <typename S, typename P>
+struct Filter_Stage {
+    using Item = typename S::Item;
+
+    S source;
+    P predicate;
+
+    template <typename F>
+    auto run(F sink) -> void {
+        source.run([&](Item item) {
+            return !predicate(item) || sink(item);
+        });
+    }
+};
+
+template <typename S>
+struct Take_Stage {
+    using Item = typename S::Item;
+
+    S source;
+    usize n;
+
+    template <typename F>
+    auto run(F sink) -> void {
+        if (n == 0)
+            return;
+
+        usize taken = 0;
+
+        source.run([&](Item item) {
+            return sink(item) && ++taken < n;
+        });
+    }
+};
+
+template <typename S>
+struct Skip_Stage {
+    using Item = typename S::Item;
+
+    S source;
+    usize n;
+
+    template <typename F>
+    auto run(F sink) -> void {
+        usize skipped = 0;
+
+        source.run([&](Item item) {
+            return skipped++ < n || sink(item);
+        });
+    }
+};
+
+// Lazy pipelines: each stage wraps the previous one and pushes items into a
+// sink that returns false to stop, so a whole chain inlines into one loop
+template <typename S>
+struct Range {
+    using Item = typename S::Item;
+
+    S source;
+
+    template <typename F>
+    auto run(F sink) -> void {
+        source.run(sink);
+    }
+
+    template <typename F>
+    auto map(F f) -> Range<Map_Stage<S, F>> {
+        return { { source, f } };
+    }
+
+    template <typename F>
+    auto filter(F f) -> Range<Filter_Stage<S, F>> {
+        return { { source, f } };
+    }
+
+    auto take(usize n) -> Range<Take_Stage<S>> {
+        return { { source, n } };
+    }
+
+    auto skip(usize n) -> Range<Skip_Stage<S>> {
+        return { { source, n } };
+    }
+
+    template <typename F>
+    auto for_each(F f) -> void {
+        run([&f](Item item) {
+            f(item);
+            return true;
+        });
+    }
+
+    template <typename A, typename F>
+    auto fold(A initial, F f) -> A {
+        run([&](Item item) {
+            initial = f(initial, item);
+            return true;
+        });
+
+        return initial;
+    }
+
+    auto count() -> usize {
+        return fold(usize(0), [](usize n, Item) { return n + 1; });
+    }
+
+    // Stages must not allocate from the same arena while collecting
+    auto collect(ptr<Arena> arena) -> Vector<Item> {
+        auto builder = Vector_Builder<Item>::create(arena);
+
+        run([&builder](Item item) {
+            builder.put(item);
+            return true;
+        });
+
+        return builder.result;
+    }
+};
+
+template <typename T>
+auto range(Container<T> items) -> Range<Container_Source<T>> {
+    return { { items } };
+}
+
+template <typename T>
+auto range(Vector<T> items) -> Range<Container_Source<T>> {
+    return { { items.view() } };
+}
+
+auto range(String text, char separator) -> Range<Split_Source> {
+    return { { text, separator } };
+}
+
+template <typename T, typename R>
+auto range(ptr<R> reader) -> Range<Reader_Source<R, T>> {
+    return { { reader } };
+}
+
+// Thompson automaton for the pattern compiler below, states are either a
+// byte set with one successor, a split with up to two epsilon edges, or accept
+struct Nfa {
+    // begin and end are the zero width ^ and $
+    enum struct Kind: u8 { epsilon, set, accept, begin, end };
+
+    struct State {
+        Kind kind;
+        i32 next;
+        i32 alt;
+        Bitset<256> set;
+    };
+
+    struct Fragment {
+        i32 start;
+        i32 end;
+    };
+
+    ptr<State> states;
+    usize count;
+    usize limit;
+
+    static auto create(ptr<Arena> arena, usize limit) -> Nfa {
+        return { arena->allocate<State>(limit), 0, limit };
+    }
+
+    auto add(Kind kind) -> i32 {
+        assert(count < limit);
+
+        states[count] = { kind, -1, -1, Bitset<256>::create() };
+
+        return static_cast<i32>(count++);
+    }
+
+    auto empty() -> Fragment {
+        auto s = add(Kind::epsilon);
+        return { s, s };
+    }
+
+    auto bytes(Bitset<256> set) -> Fragment {
+        auto s = add(Kind::set);
+        auto e = add(Kind::epsilon);
+
+        states[s].set = set;
+        states[s].next = e;
+
+        return { s, e };
+    }
+
+    auto assertion(Kind kind) -> Fragment {
+        auto s = add(kind);
+        auto e = add(Kind::epsilon);
+
+        states[s].next = e;
+
+        return { s, e };
+    }
+
+    auto concat(Fragment a, Fragment b) -> Fragment {
+        states[a.end].next = b.start;
+        return { a.start, b.end };
+    }
+
+    auto either(Fragment a, Fragment b) -> Fragment {
+        auto s = add(Kind::epsilon);
+        auto e = add(Kind::epsilon);
+
+        states[s].next = a.start;
+        states[s].alt = b.start;
+        states[a.end].next = e;
+        states[b.end].next = e;
+
+        return { s, e };
+    }
+
+    auto star(Fragment a) -> Fragment {
+        auto s = add(Kind::epsilon);
+        auto e = add(Kind::epsilon);
+
+        states[s].next = a.start;
+        states[s].alt = e;
+        states[a.end].next = s;
+
+        return { s, e };
+    }
+
+    auto plus(Fragment a) -> Fragment {
+        auto s = add(Kind::epsilon);
+        auto e = add(Kind::epsilon);
+
+        states[a.end].next = s;
+        states[s].next = a.start;
+        states[s].alt = e;
+
+        return { a.start, e };
+    }
+
+    auto optional(Fragment a) -> Fragment {
+        auto s = add(Kind::epsilon);
+
+        states[s].next = a.start;
+        states[s].alt = a.end;
+
+        return { s, a.end };
+    }
+
+    // Adds the epsilon closure of state to set, passing ^ only at_begin and
+    // $ only at_end
+    auto close(Bit_Vector set, i32 state, ptr<i32> stack, bool at_begin = false, bool at_end = false) -> void {
+        usize top = 0;
+        stack[top++] = state;
+
+        while (top > 0) {
+            auto s = stack[--top];
+
+            if (s < 0 || set.test(static_cast<usize>(s)))
+                continue;
+
+            set.set(static_cast<usize>(s));
+
+            auto kind = states[s].kind;
+
+            if (kind == Kind::epsilon) {
+                stack[top++] = states[s].next;
+                stack[top++] = states[s].alt;
+            } else if ((kind == Kind::begin && at_begin) || (kind == Kind::end && at_end)) {
+                stack[top++] = states[s].next;
+            }
+        }
+    }
+};
+
+// Recursive descent over regex (literals, ., [classes], \d \w \s, * + ?, |,
+// groups, ^ $) or glob (*, ?, [classes], {a,b}) syntax
+struct Pattern_Parser {
+    String text;
+    usize position;
+    bool glob;
+    usize depth;
+    ptr<Nfa> nfa;
+    bool failed;
+
+    auto done() -> bool {
+        return position >= text.length;
+    }
+
+    // Malformed pattern, skipping the rest ends every loop above
+    auto fail() -> void {
+        failed = true;
+        position = text.length;
+    }
+
+    auto peek() -> char {
+        return text.data[position];
+    }
+
+    auto any() -> Bitset<256> {
+        auto set = Bitset<256>::create();
+        set.view().flip();
+        return set;
+    }
+
+    auto single(char c) -> Bitset<256> {
+        auto set = Bitset<256>::create();
+        set.set(static_cast<u8>(c));
+        return set;
+    }
+
+    auto range(ref<Bitset<256>> set, u8 first, u8 last) -> void {
+        for (usize c = first; c <= last; ++c)
+            set.set(c);
+    }
+
+    auto escape(char c) -> Bitset<256> {
+        auto set = Bitset<256>::create();
+
+        if (!glob && c == 'd') {
+            range(set, '0', '9');
+        } else if (!glob && c == 'w') {
+            range(set, '0', '9');
+            range(set, 'a', 'z');
+            range(set, 'A', 'Z');
+            set.set('_');
+        } else if (!glob && c == 's') {
+            for (auto it: make_array<char>(' ', '\t', '\n', '\r', '\f', '\v'))
+                set.set(static_cast<u8>(it));
+        } else {
+            set.set(static_cast<u8>(c));
+        }
+
+        return set;
+    }
+
+    auto bracket() -> Bitset<256> {
+        auto set = Bitset<256>::create();
+        bool negate = false;
+
+        if (!done() && (peek() == '^' || (glob && peek() == '!'))) {
+            negate = true;
+            ++position;
+        }
+
+        for (bool first = true; ; first = false) {
+            if (done()) {
+                fail();
+                return set;
+            }
+
+            auto c = text.data[position++];
+
+            if (c == ']' && !first)
+                break;
+
+            if (c == '\\') {
+                if (done()) {
+                    fail();
+                    return set;
+                }
+
+                auto escaped = escape(text.data[position++]);
+                set |= escaped;
+
+                continue;
+            }
+
+            if (position + 1 < text.length && peek() == '-' && text.data[position + 1] != ']') {
+                range(set, static_cast<u8>(c), static_cast<u8>(text.data[position + 1]));
+                position += 2;
+            } else {
+                set.set(static_cast<u8>(c));
+            }
+        }
+
+        if (negate)
+            set.view().flip();
+
+        return set;
+    }
+
+    auto stop() -> bool {
+        if (done())
+            return true;
+
+        auto c = peek();
+
+        if (glob)
+            return depth > 0 && (c == ',' || c == '}');
+
+        return c == '|' || c == ')';
+    }
+
+    auto atom() -> Nfa::Fragment {
+        auto c = text.data[position++];
+
+        if (c == '\\') {
+            if (done()) {
+                fail();
+                return nfa->empty();
+            }
+
+            return nfa->bytes(escape(text.data[position++]));
+        }
+
+        if (c == '[')
+            return nfa->bytes(bracket());
+
+        if (glob) {
+            if (c == '*')
+                return nfa->star(nfa->bytes(any()));
+
+            if (c == '?')
+                return nfa->bytes(any());
+
+            if (c == '{') {
+                ++depth;
+                auto inner = alternation(',');
+                --depth;
+
+                if (done() || peek() != '}') {
+                    fail();
+                    return inner;
+                }
+
+                ++position;
+
+                return inner;
+            }
+
+            return nfa->bytes(single(c));
+        }
+
+        if (c == '(') {
+            auto inner = alternation('|');
+
+            if (done() || peek() != ')') {
+                fail();
+                return inner;
+            }
+
+            ++position;
+
+            return inner;
+        }
+
+        if (c == '.')
+            return nfa->bytes(any());
+
+        if (c == '^')
+            return nfa->assertion(Nfa::Kind::begin);
+
+        if (c == '$')
+            return nfa->assertion(Nfa::Kind::end);
+
+        // A repeat with nothing to repeat
+        if (c == '*' || c == '+' || c == '?') {
+            fail();
+            return nfa->empty();
+        }
+
+        return nfa->bytes(single(c));
+    }
+
+    auto repeat() -> Nfa::Fragment {
+        auto fragment = atom();
+
+        while (!glob && !done()) {
+            if (peek() == '*')
+                fragment = nfa->star(fragment);
+            else if (peek() == '+')
+                fragment = nfa->plus(fragment);
+            else if (peek() == '?')
+                fragment = nfa->optional(fragment);
+            else
+                break;
+
+            ++position;
+        }
+
+        return fragment;
+    }
+
+    auto sequence() -> Nfa::Fragment {
+        auto fragment = nfa->empty();
+
+        while (!stop())
+            fragment = nfa->concat(fragment, repeat());
+
+        return fragment;
+    }
+
+    auto alternation(char separator) -> Nfa::Fragment {
+        auto fragment = sequence();
+
+        while (!done() && peek() == separator) {
+            ++position;
+            fragment = nfa->either(fragment, sequence());
+        }
+
+        return fragment;
+    }
+};
+
+// Pattern compiled once into a DFA over byte classes, kept in an arena.
+// Matching reads each byte once and never backtracks. Patterns whose DFA
+// would need more than max_states states, and malformed ones, fail to
+// compile, see valid()
+struct Matcher {
+    static constexpr usize max_states = 4096;
+
+    usize classes;
+    ptr<u8> class_of;
+    ptr<u16> table;
+    ptr<bool> accepting;
+    // Accepting once the pending $ are satisfied at the end of the text
+    ptr<bool> accepting_at_end;
+    u16 start;
+    // Start state for scans that skip ahead to the prefix, where ^ fails
+    u16 resume;
+    // Every match begins at the start of the text
+    bool anchored_start;
+    // Empty text is where ^ and $ hold together
+    bool matches_empty;
+    // Every match begins with this literal
+    String prefix;
+
+    static auto regex(ptr<Arena> arena, String pattern) -> Matcher {
+        return compile(arena, pattern, false);
+    }
+
+    // Whole string match, * and ? also match '/'
+    static auto glob(ptr<Arena> arena, String pattern) -> Matcher {
+        return compile(arena, pattern, true);
+    }
+
+    auto valid() -> bool {
+        return table != nullptr;
+    }
+
+    static auto compile(ptr<Arena> arena, String pattern, bool glob) -> Matcher {
+        auto limit = pattern.length * 4 + 24;
+        auto words = (limit + 63) / 64;
+
+        auto scratch = Arena::create(
+            limit * (sizeof(Nfa::State) + 2 * sizeof(i32))
+            + max_states * (words * sizeof(u64) + 256 * sizeof(u16) + 16)
+            + 4096);
+        defer cleanup = [&scratch](){ scratch.destroy(); };
+
+        auto nfa = Nfa::create(&scratch, limit);
+        auto parser = Pattern_Parser { pattern, 0, glob, 0, &nfa, false };
+
+        auto body = parser.alternation('|');
+
+        // An unmatched ) stops the top level early
+        if (parser.failed || !parser.done())
+            return Matcher {};
+
+        if (glob)
+            body = nfa.concat(nfa.assertion(Nfa::Kind::begin), nfa.concat(body, nfa.assertion(Nfa::Kind::end)));
+
+        auto accept = nfa.add(Nfa::Kind::accept);
+        nfa.states[body.end].next = accept;
+
+        auto stack = scratch.allocate<i32>(limit * 2 + 2);
+        auto matcher = Matcher {};
+
+        matcher.prefix = literal_prefix(arena, &scratch, &nfa, body.start, stack, &matcher.anchored_start);
+
+        auto entry = body.start;
+
+        if (!matcher.anchored_start)
+            entry = nfa.concat(nfa.star(nfa.bytes(parser.any())), body).start;
+
+        // Bytes that no byte set tells apart share a class
+        matcher.class_of = arena->allocate<u8>(256);
+        memset(reinterpret_cast<ptr<char>>(matcher.class_of), 0, 256);
+
+        usize classes = 1;
+
+        for (usize s = 0; s < nfa.count; ++s) {
+            if (nfa.states[s].kind != Nfa::Kind::set)
+                continue;
+
+            buf<i16, 512> split;
+            memset(reinterpret_cast<ptr<char>>(split), 0xff, sizeof(split));
+
+            usize next = 0;
+
+            for (usize c = 0; c < 256; ++c) {
+                auto key = matcher.class_of[c] * 2 + nfa.states[s].set.test(c);
+
+                if (split[key] < 0)
+                    split[key] = static_cast<i16>(next++);
+
+                matcher.class_of[c] = static_cast<u8>(split[key]);
+            }
+
+            classes = next;
+        }
+
+        matcher.classes = classes;
+
+        buf<u8, 256> representative;
+
+        for (usize c = 256; c > 0; --c)
+            representative[matcher.class_of[c - 1]] = static_cast<u8>(c - 1);
+
+        // Subset construction, state 0 is the dead state
+        auto sets = scratch.allocate<Bit_Vector>(max_states);
+        auto table = scratch.allocate<u16>(max_states * classes);
+        usize count = 0;
+        bool overflow = false;
+
+        auto make_set = [&]() {
+            return Bit_Vector { nfa.count, scratch.allocate<u64>(words) };
+        };
+
+        auto find = [&](Bit_Vector set) -> u16 {
+            // Only byte sets, accept and pending $ decide behaviour, drop the rest
+            for (usize s = 0; s < nfa.count; ++s)
+                if (nfa.states[s].kind == Nfa::Kind::epsilon || nfa.states[s].kind == Nfa::Kind::begin)
+                    set.reset(s);
+
+            for (usize i = 0; i < count; ++i)
+                if (memcmp(reinterpret_cast<ptr<char>>(sets[i].words), reinterpret_cast<ptr<char>>(set.words), words * sizeof(u64)) == 0)
+                    return static_cast<u16>(i);
+
+            if (count == max_states) {
+                overflow = true;
+                return 0;
+            }
+
+            sets[count] = make_set();
+            memcpy(reinterpret_cast<ptr<char>>(sets[count].words), reinterpret_cast<ptr<char>>(set.words), words * sizeof(u64));
+
+            return static_cast<u16>(count++);
+        };
+
+        auto set = make_set();
+
+        set.clear();
+        find(set);
+
+        nfa.close(set, entry, stack, true);
+        matcher.start = find(set);
+
+        set.clear();
+        nfa.close(set, entry, stack);
+        matcher.resume = find(set);
+
+        set.clear();
+        nfa.close(set, entry, stack, true, true);
+        matcher.matches_empty = set.test(static_cast<usize>(accept));
+
+        for (usize i = 0; i < count && !overflow; ++i) {
+            for (usize k = 0; k < classes; ++k) {
+                set.clear();
+
+                for (auto s: sets[i].ones())
+                    if (nfa.states[s].kind == Nfa::Kind::set && nfa.states[s].set.test(representative[k]))
+                        nfa.close(set, nfa.states[s].next, stack);
+
+                table[i * classes + k] = find(set);
+            }
+        }
+
+        if (overflow)
+            return Matcher {};
+
+        matcher.table = arena->allocate<u16>(count * classes);
+        memcpy(reinterpret_cast<ptr<char>>(matcher.table), reinterpret_cast<ptr<char>>(table), count * classes * sizeof(u16));
+
+        matcher.accepting = arena->allocate<bool>(count);
+        matcher.accepting_at_end = arena->allocate<bool>(count);
+
+        for (usize i = 0; i < count; ++i) {
+            matcher.accepting[i] = sets[i].test(static_cast<usize>(accept));
+
+            set.clear();
+
+            for (auto s: sets[i].ones())
+                nfa.close(set, static_cast<i32>(s), stack, false, true);
+
+            matcher.accepting_at_end[i] = set.test(static_cast<usize>(accept));
+        }
+
+        return matcher;
+    }
+
+    // Follows the automaton while it can only go through one fixed byte,
+    // anchored is set when nothing can be matched without passing a ^
+    static auto literal_prefix(ptr<Arena> arena, ptr<Arena> scratch, ptr<Nfa> nfa, i32 state, ptr<i32> stack, ptr<bool> anchored) -> String {
+        auto builder = String_Builder::create(arena);
+        auto set = Bit_Vector { nfa->count, scratch->allocate<u64>((nfa->count + 63) / 64) };
+
+        set.clear();
+        nfa->close(set, state, stack);
+
+        *anchored = true;
+
+        for (auto s: set.ones())
+            if (nfa->states[s].kind != Nfa::Kind::epsilon && nfa->states[s].kind != Nfa::Kind::begin)
+                *anchored = false;
+
+        for (bool first = true; ; first = false) {
+            set.clear();
+            nfa->close(set, state, stack, first);
+
+            i32 only = -1;
+
+            for (auto s: set.ones()) {
+                auto kind = nfa->states[s].kind;
+
+                if (kind == Nfa::Kind::accept || kind == Nfa::Kind::end || (kind == Nfa::Kind::begin && !first)
+                    || (kind == Nfa::Kind::set && only >= 0))
+                    return builder.result;
+
+                if (kind == Nfa::Kind::set)
+                    only = static_cast<i32>(s);
+            }
+
+            if (only < 0 || nfa->states[only].set.count() != 1)
+                return builder.result;
+
+            builder.put(static_cast<char>(*nfa->states[only].set.ones().begin()));
+            state = nfa->states[only].next;
+        }
+    }
+
+    auto match(String text) -> bool {
+        assert(valid());
+
+        if (text.length == 0)
+            return matches_empty;
+
+        usize i = 0;
+
+        if (prefix.length > 0) {
+            i = anchored_start ? 0 : text.find(prefix);
+
+            if (i + prefix.length > text.length || !(text.chop_left(i).left(prefix.length) == prefix))
+                return false;
+        }
+
+        auto state = i == 0 ? start : resume;
+
+        for (;; ++i) {
+            if (accepting[state])
+                return true;
+
+            if (state == 0 || i == text.length)
+                break;
+
+            state = table[state * classes + class_of[static_cast<u8>(text.data[i])]];
+        }
+
+        return accepting_at_end[state];
     }
 };
 
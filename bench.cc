@@ -0,0 +1,460 @@
+#include <time.h>
+#include <errno.h>
+
+#include "basic.cc"
+#include "os.cc"
+
+auto now() -> f64 {
+    timespec ts;
+    assert(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+
+    return static_cast<f64>(ts.tv_sec) + static_cast<f64>(ts.tv_nsec) * 1e-9;
+}
+
+template <typename F>
+auto measure(ptr<imm<char>> name, F body) -> void {
+    auto start = now();
+
+    body();
+
+    println("%-40s %10.2f ms", name, (now() - start) * 1e3);
+}
+
+struct Random {
+    u64 state;
+
+    static auto create(u64 seed) -> Random {
+        return { seed | 1 };
+    }
+
+    auto next() -> u64 {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+
+        return state * 2685821657736338717ull;
+    }
+};
+
+template <typename T>
+auto compare(ptr<imm<void>> a, ptr<imm<void>> b) -> int {
+    auto x = *static_cast<ptr<imm<T>>>(a);
+    auto y = *static_cast<ptr<imm<T>>>(b);
+
+    return x < y ? -1 : (y < x ? 1 : 0);
+}
+
+template <typename T>
+auto bench_sort_keys(ptr<Arena> arena, ptr<imm<char>> distribution, Container<T> keys) -> void {
+    auto mark = arena->position;
+    defer restore = [arena, mark](){ arena->position = mark; };
+
+    auto n = keys.tail;
+    auto work = Container<T> { n, n, arena->allocate<T>(n) };
+
+    auto reset = [&]() {
+        memcpy(work.data, keys.data, n * sizeof(T));
+    };
+
+    auto check = [&]() {
+        for (usize i = 1; i < n; ++i)
+            assert(!(work[i] < work[i - 1]));
+    };
+
+    println("%s, %zu keys of %zu bytes", distribution, n, sizeof(T));
+
+    reset();
+    measure("  qsort", [&]() { qsort(work.data, n, sizeof(T), compare<T>); });
+    check();
+
+    reset();
+    measure("  sort", [&]() { sort(work); });
+    check();
+
+    reset();
+    measure("  radix_sort", [&]() { radix_sort(arena, work); });
+    check();
+
+    reset();
+    measure("  parallel_sort", [&]() { parallel_sort(arena, work, cpu_count()); });
+    check();
+}
+
+auto bench_sort(ptr<Arena> arena) -> void {
+    static constexpr usize n = 1 << 22;
+
+    auto random = Random::create(42);
+
+    auto mark = arena->position;
+    defer restore = [arena, mark](){ arena->position = mark; };
+
+    auto keys = Vector<u32>::create(arena, n);
+
+    for (usize i = 0; i < n; ++i)
+        keys.append(static_cast<u32>(random.next()));
+
+    bench_sort_keys(arena, "uniform", keys.view());
+
+    for (usize i = 0; i < n; ++i)
+        keys[i] = static_cast<u32>(random.next() % 16);
+
+    bench_sort_keys(arena, "16 distinct", keys.view());
+
+    for (usize i = 0; i < n; ++i)
+        keys[i] = static_cast<u32>(i + random.next() % 64);
+
+    bench_sort_keys(arena, "nearly sorted", keys.view());
+
+    auto wide = Vector<u64>::create(arena, n);
+
+    for (usize i = 0; i < n; ++i)
+        wide.append(random.next());
+
+    bench_sort_keys(arena, "uniform", wide.view());
+
+    auto strings = Vector<String>::create(arena, n / 4);
+
+    for (usize i = 0; i < strings.size(); ++i) {
+        auto word = arena->allocate<char>(12);
+        auto length = 4 + random.next() % 8;
+
+        for (usize c = 0; c < length; ++c)
+            word[c] = static_cast<char>('a' + random.next() % 26);
+
+        strings.append(String::create(word, length));
+    }
+
+    bench_sort_keys(arena, "words", strings.view());
+}
+
+auto bench_search(ptr<Arena> arena) -> void {
+    static constexpr usize n = 1 << 20;
+    static constexpr usize queries = 1 << 22;
+
+    auto mark = arena->position;
+    defer restore = [arena, mark](){ arena->position = mark; };
+
+    auto keys = Vector<u32>::create(arena, n);
+
+    for (usize i = 0; i < n; ++i)
+        keys.append(static_cast<u32>(i * 3));
+
+    auto random = Random::create(7);
+    auto targets = Vector<u32>::create(arena, queries);
+
+    for (usize i = 0; i < queries; ++i)
+        targets.append(static_cast<u32>(random.next() % (n * 3)));
+
+    println("lower_bound, %zu queries over %zu keys", queries, n);
+
+    usize sum = 0;
+
+    measure("  lower_bound", [&]() {
+        for (auto it: targets)
+            sum += lower_bound(keys.view(), it);
+    });
+
+    measure("  lower_bound_branchless", [&]() {
+        for (auto it: targets)
+            sum -= lower_bound_branchless(keys.view(), it);
+    });
+
+    assert(sum == 0);
+}
+
+auto bench_files(ptr<Arena> arena) -> void {
+    static constexpr usize n = 4000;
+
+    auto mark = arena->position;
+    defer restore = [arena, mark](){ arena->position = mark; };
+
+    assert(mkdir("/tmp/basic_bench", 0755) == 0 || errno == EEXIST);
+
+    auto random = Random::create(3);
+    auto paths = Vector<String>::create(arena, n);
+    auto contents = arena->allocate<char>(8192);
+
+    for (usize i = 0; i < n; ++i) {
+        auto path = String::create("/tmp/basic_bench/%zu.txt").format(arena, i);
+        auto fd = open(path.cstr(arena), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        assert(fd >= 0);
+        assert(write(fd, contents, 512 + random.next() % 7680) >= 0);
+        close(fd);
+
+        paths.append(path);
+    }
+
+    println("loading %zu small files", n);
+
+    usize expected = 0;
+
+    measure("  String::from_file", [&]() {
+        for (auto it: paths)
+            expected += String::from_file(arena, it).length;
+    });
+
+    auto check = [&](Vector<String> files) {
+        usize total = 0;
+
+        for (auto it: files)
+            total += it.length;
+
+        assert(total == expected);
+    };
+
+    auto loader = File_Loader::create(arena);
+    defer cleanup = [&loader](){ loader.destroy(); };
+
+    if (loader.ring.fd >= 0)
+        measure("  File_Loader io_uring", [&]() { check(loader.load(paths.view())); });
+
+    auto pooled = File_Loader::create(arena, 0);
+
+    measure("  File_Loader thread pool", [&]() { check(pooled.load(paths.view())); });
+}
+
+auto bench_bits(ptr<Arena> arena) -> void {
+    static constexpr usize n = 1 << 24;
+
+    auto mark = arena->position;
+    defer restore = [arena, mark](){ arena->position = mark; };
+
+    auto random = Random::create(11);
+
+    auto a = Vector<u8>::create(arena, n);
+    auto b = Vector<u8>::create(arena, n);
+    auto x = Bit_Vector::create(arena, n);
+    auto y = Bit_Vector::create(arena, n);
+
+    for (usize i = 0; i < n; ++i) {
+        auto r = random.next();
+
+        a.append(static_cast<u8>(r & 1));
+        b.append(static_cast<u8>((r >> 1) & 1));
+        x.assign(i, r & 1);
+        y.assign(i, (r >> 1) & 1);
+    }
+
+    println("filter masks, %zu records", n);
+
+    usize bytes = 0;
+    usize bits = 0;
+
+    measure("  Vector<u8> and + count", [&]() {
+        for (usize i = 0; i < n; ++i) {
+            a[i] &= b[i];
+            bytes += a[i];
+        }
+    });
+
+    measure("  Bit_Vector and + count", [&]() {
+        x &= y;
+        bits = x.count();
+    });
+
+    assert(bytes == bits);
+}
+
+struct Pair {
+    u64 first;
+    u64 second;
+};
+
+auto bench_shared_arena() -> void {
+    // Fixed total so the arena holds every run whatever the thread count
+    static constexpr usize total = 1 << 24;
+
+    auto shared = Shared_Arena::create(usize(1) << 30);
+    defer cleanup = [&shared](){ shared.destroy(); };
+
+    auto top = cpu_count() < 8 ? 8 : cpu_count();
+
+    println("arena allocations, %zu 16 byte objects split across threads", total);
+
+    for (usize threads = 1; threads <= top && threads <= 64; threads *= 2) {
+        auto n = total / threads;
+
+        println("  %zu threads", threads);
+
+        auto lock = Spinlock::create();
+        shared.arena.position = 0;
+
+        measure("    Arena behind a Spinlock", [&]() {
+            parallel(threads, [&](usize) {
+                for (usize i = 0; i < n; ++i) {
+                    lock.lock();
+                    shared.arena.make<Pair>();
+                    lock.unlock();
+                }
+            });
+        });
+
+        shared.arena.position = 0;
+
+        measure("    atomic add per allocation", [&]() {
+            parallel(threads, [&](usize) {
+                for (usize i = 0; i < n; ++i)
+                    __atomic_fetch_add(&shared.arena.position, 16, __ATOMIC_RELAXED);
+            });
+        });
+
+        shared.arena.position = 0;
+
+        measure("    Local_Arena", [&]() {
+            parallel(threads, [&](usize) {
+                auto local = Local_Arena::create(&shared);
+
+                for (usize i = 0; i < n; ++i)
+                    local.make<Pair>();
+            });
+        });
+    }
+}
+
+auto random_reads(ptr<Arena> arena, usize n) -> u64 {
+    auto values = arena->allocate<u64>(n);
+
+    for (usize i = 0; i < n; ++i)
+        values[i] = i;
+
+    auto random = Random::create(5);
+    u64 sum = 0;
+
+    measure("  random reads", [&]() {
+        for (usize i = 0; i < (1 << 25); ++i)
+            sum += values[random.next() % n];
+    });
+
+    return sum;
+}
+
+// What map_arena actually set up, which can be less than was asked for
+auto describe(Arena_Options backing) -> void {
+    auto pages = backing.explicit_huge_pages ? "explicit huge" : backing.huge_pages ? "transparent huge" : "plain";
+
+    if (backing.node >= 0)
+        println("  got %s pages on node %d", pages, backing.node);
+    else
+        println("  got %s pages, default placement", pages);
+}
+
+auto bench_huge_pages() -> void {
+    static constexpr usize bytes = usize(1) << 30;
+    static constexpr usize n = bytes / sizeof(u64) - 1024;
+
+    println("random access over %zu MB", bytes >> 20);
+
+    u64 expected;
+
+    {
+        println(" malloc");
+
+        auto arena = Arena::create(bytes);
+        defer cleanup = [&arena](){ arena.destroy(); };
+
+        expected = random_reads(&arena, n);
+    }
+
+    {
+        println(" map_arena, transparent huge pages asked");
+
+        Arena_Options backing;
+        auto arena = map_arena(bytes, Arena_Options::create(), &backing);
+        defer cleanup = [&arena](){ arena.destroy(); };
+
+        describe(backing);
+
+        assert(random_reads(&arena, n) == expected);
+    }
+
+    {
+        println(" map_arena, explicit huge pages on node 0 asked, prefaulted");
+
+        auto options = Arena_Options::create();
+        options.explicit_huge_pages = true;
+        options.node = 0;
+        options.prefault = true;
+
+        Arena_Options backing;
+        auto arena = map_arena(bytes, options, &backing);
+        defer cleanup = [&arena](){ arena.destroy(); };
+
+        describe(backing);
+
+        assert(random_reads(&arena, n) == expected);
+    }
+}
+
+auto bench_processes(ptr<Arena> arena) -> void {
+    static constexpr usize n = 500;
+
+    println("processes, %zu runs of echo", n);
+
+    measure("  fork, execvp, waitpid one at a time", [&]() {
+        for (usize i = 0; i < n; ++i) {
+            auto pid = fork();
+            assert(pid >= 0);
+
+            if (pid == 0) {
+                auto devnull = open("/dev/null", O_WRONLY);
+                dup2(devnull, STDOUT_FILENO);
+                execlp("echo", "echo", "hello", static_cast<ptr<char>>(0));
+                _exit(127);
+            }
+
+            int status;
+            waitpid(pid, &status, 0);
+        }
+    });
+
+    for (usize limit: make_array<usize>(usize(1), usize(8))) {
+        auto mark = arena->position;
+        auto pool = Process_Pool::create(arena, limit);
+        usize bytes = 0;
+
+        println("  Process_Pool, %zu at a time", limit);
+
+        measure("    posix_spawn with captured output", [&]() {
+            for (usize i = 0; i < n; ++i) {
+                pool.spawn("echo", "hello");
+
+                while (pool.ready())
+                    bytes += pool.wait().out.length;
+            }
+
+            while (pool.busy())
+                bytes += pool.wait().out.length;
+        });
+
+        assert(bytes == n * 6);
+        arena->position = mark;
+    }
+}
+
+auto main(int argc, ptr<ptr<char>> argv) -> int {
+    auto arena = Arena::create(usize(1) << 30);
+    defer cleanup = [&arena](){ arena.destroy(); };
+
+    // Runs every benchmark, or only the ones named on the command line
+    auto wanted = [argc, argv](ptr<imm<char>> name) {
+        if (argc < 2)
+            return true;
+
+        for (int i = 1; i < argc; ++i)
+            if (String::create(argv[i]) == name)
+                return true;
+
+        return false;
+    };
+
+    if (wanted("sort")) bench_sort(&arena);
+    if (wanted("search")) bench_search(&arena);
+    if (wanted("files")) bench_files(&arena);
+    if (wanted("bits")) bench_bits(&arena);
+    if (wanted("shared_arena")) bench_shared_arena();
+    if (wanted("huge_pages")) bench_huge_pages();
+    if (wanted("processes")) bench_processes(&arena);
+
+    return 0;
+}
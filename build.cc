@@ -1,7 +1,5 @@
-#include <unistd.h>
-#include <sys/wait.h>
-
 #include "basic.cc"
+#include "os.cc"
 
 #define FLAGS "-std=c++17", "-pedantic", \
     "-Wall", "-Wextra", "-Wshadow", \
@@ -24,29 +22,24 @@ auto absolute_path(ptr<Arena> arena, String file) -> String {
 
 template <typename ...A>
 auto run_command(A... args) -> void {
-    auto arena = Arena::create(1024);
+    auto arena = Arena::create(16 << 20);
     defer cleanup = [&arena](){ arena.destroy(); };
 
-    auto cmd = make_array<ptr<imm<char>>>(args..., static_cast<ptr<char>>(0));
+    auto cmd = make_array<ptr<imm<char>>>(args...);
     auto strings = make_array<String>(String::create(args)...);
 
     println(String::create(" ").join(&arena, strings.view()));
 
-    auto bin = (strings[0].left(2) == "./")
-        ? absolute_path(&arena, strings[0]).cstr(&arena)
-        : cmd[0];
+    if (strings[0].left(2) == "./")
+        cmd[0] = absolute_path(&arena, strings[0]).cstr(&arena);
 
-    pid_t pid = fork();
+    auto pool = Process_Pool::create(&arena, 1);
+    pool.spawn(cmd.view());
 
-    assert(pid >= 0);
+    auto result = pool.wait();
 
-    if (pid == 0) {
-        execvp(const_cast<ptr<char>>(bin), const_cast<ptr<imm<ptr<char>>>>(cmd.data));
-        assert(false);
-    } else {
-        int status;
-        waitpid(pid, &status, 0);
-    }
+    assert(write(STDOUT_FILENO, result.out.data, result.out.length) >= 0);
+    assert(write(STDERR_FILENO, result.err.data, result.err.length) >= 0);
 }
 
 auto build_self() -> void {
@@ -59,6 +52,10 @@ auto build_tests() -> void {
     run_command("cc", FLAGS, "-o", "run_tests", "run_tests.cc");
 }
 
+auto build_bench() -> void {
+    run_command("cc", FLAGS, "-O2", "-o", "run_bench", "bench.cc");
+}
+
 auto build_wasm() -> void {
     auto src = "wasm/main.cc";
     auto bin = "wasm/index.wasm";
@@ -69,6 +66,7 @@ auto build_wasm() -> void {
 auto clean() -> void {
     run_command("rm", "wasm/index.wasm");
     run_command("rm", "run_tests");
+    run_command("rm", "run_bench");
     run_command("rm", "build");
 }
 
@@ -79,6 +77,8 @@ auto main(int argc, ptr<ptr<char>> argv) -> int {
         build_self();
     else if (type == "wasm")
         build_wasm();
+    else if (type == "bench")
+        build_bench();
     else if (type == "clean")
         clean();
     else {
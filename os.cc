@@ -0,0 +1,1597 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/mempolicy.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <time.h>
+
+struct Thread {
+    pthread_t handle;
+
+    // callback must outlive the thread
+    template <typename F>
+    static auto create(ptr<F> callback) -> Thread {
+        auto thread = Thread {};
+
+        auto run = [](ptr<void> f) -> ptr<void> {
+            (*static_cast<ptr<F>>(f))();
+            return nullptr;
+        };
+
+        assert(pthread_create(&thread.handle, NULL, run, callback) == 0);
+
+        return thread;
+    }
+
+    auto join() -> void {
+        assert(pthread_join(handle, NULL) == 0);
+    }
+};
+
+auto cpu_count() -> usize {
+    auto n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? static_cast<usize>(n) : 1;
+}
+
+// Runs body(0) .. body(n - 1) concurrently, body(0) on the calling thread
+template <typename F>
+auto parallel(usize n, F body) -> void {
+    struct Task {
+        ptr<F> body;
+        usize index;
+
+        auto operator()() -> void {
+            (*body)(index);
+        }
+    };
+
+    auto tasks = Array<Task, 64>::create();
+    auto threads = Stack<Thread, 64>::create();
+
+    assert(n <= 64);
+
+    for (usize i = 0; i < n; ++i)
+        tasks.append({ &body, i });
+
+    for (usize i = 1; i < n; ++i)
+        threads.push(Thread::create(&tasks[i]));
+
+    body(0);
+
+    while (threads.size() > 0)
+        threads.pop().join();
+}
+
+// Splits text on row boundaries and parses the chunks on separate threads
+auto csv_parallel(ptr<Arena> arena, String text, Csv_Options options, usize threads) -> Csv_Table {
+    auto table = Csv_Table::layout(arena, text, options);
+    table.infer();
+
+    auto body = table.body;
+
+    if (threads == 0)
+        threads = 1;
+
+    if (threads > 64)
+        threads = 64;
+
+    if (threads > body.length / 4096 + 1)
+        threads = body.length / 4096 + 1;
+
+    buf<usize, 65> starts;
+    buf<usize, 64> rows;
+    buf<bool, 64> parity;
+
+    starts[threads] = body.length;
+
+    parallel(threads, [&](usize k) {
+        usize quotes = 0;
+
+        for (usize i = k * body.length / threads; i < (k + 1) * body.length / threads; ++i)
+            quotes += body.data[i] == '"';
+
+        parity[k] = quotes % 2;
+    });
+
+    parallel(threads, [&](usize k) {
+        auto boundary = k * body.length / threads;
+
+        bool quoted = false;
+
+        for (usize i = 0; i < k; ++i)
+            quoted ^= parity[i];
+
+        starts[k] = k == 0 ? 0 : boundary + Csv_Scanner::create(body.chop_left(boundary), options.separator, quoted)
+            .scan([](usize, usize, bool last) { return !last; });
+    });
+
+    for (usize k = threads - 1; k > 0; --k)
+        if (starts[k] > starts[k + 1])
+            starts[k] = starts[k + 1];
+
+    auto chunk = [&](usize k) -> String {
+        return { body.data + starts[k], starts[k + 1] - starts[k] };
+    };
+
+    parallel(threads, [&](usize k) {
+        rows[k] = table.count(chunk(k), false);
+    });
+
+    usize total = 0;
+
+    for (usize k = 0; k < threads; ++k) {
+        auto n = rows[k];
+        rows[k] = total;
+        total += n;
+    }
+
+    table.reserve(arena, total);
+
+    // Unescaped text fields never outgrow their chunk
+    bool text_columns = false;
+
+    for (auto it: table.columns)
+        text_columns |= it.type == Csv_Type::text;
+
+    buf<Arena, 64> scratch;
+
+    for (usize k = 0; k < threads; ++k)
+        scratch[k] = arena->carve(text_columns ? chunk(k).length : 0);
+
+    parallel(threads, [&](usize k) {
+        table.fill(&scratch[k], chunk(k), false, rows[k]);
+    });
+
+    table.rows = total;
+
+    return table;
+}
+
+// Elements taken from a when the first k outputs of a stable merge are produced
+template <typename T, typename F>
+auto co_rank(usize k, ptr<T> a, usize m, ptr<T> b, usize n, F less) -> usize {
+    auto low = k > n ? k - n : 0;
+    auto high = k < m ? k : m;
+
+    while (low < high) {
+        auto i = low + (high - low) / 2;
+
+        if (!less(b[k - i - 1], a[i]))
+            low = i + 1;
+        else
+            high = i;
+    }
+
+    return low;
+}
+
+template <typename T, typename F>
+auto merge(ptr<T> a, usize m, ptr<T> b, usize n, ptr<T> out, F less) -> void {
+    usize i = 0;
+    usize j = 0;
+
+    while (i < m && j < n)
+        *out++ = less(b[j], a[i]) ? b[j++] : a[i++];
+
+    while (i < m)
+        *out++ = a[i++];
+
+    while (j < n)
+        *out++ = b[j++];
+}
+
+// Sorts one chunk per thread, then merges pairs of runs with every round
+// split across all threads along the merge path
+template <typename T, typename F>
+auto parallel_sort(ptr<Arena> arena, Container<T> items, usize threads, F less) -> void {
+    auto n = items.tail;
+
+    usize count = 1;
+
+    while (count * 2 <= threads && count * 2 <= 64 && n / (count * 2) >= 4096)
+        count *= 2;
+
+    if (count == 1) {
+        sort(items, less);
+        return;
+    }
+
+    auto mark = arena->position;
+    defer restore = [arena, mark](){ arena->position = mark; };
+
+    auto src = items.data;
+    auto dst = arena->allocate<T>(n);
+
+    auto bound = [n, count](usize k) -> usize {
+        return k * n / count;
+    };
+
+    parallel(count, [&](usize k) {
+        sort(Container<T> { bound(k + 1) - bound(k), bound(k + 1) - bound(k), src + bound(k) }, less);
+    });
+
+    for (usize width = 1; width < count; width *= 2) {
+        auto pieces = width * 2;
+
+        parallel(count, [&](usize t) {
+            auto pair = t / pieces;
+            auto piece = t % pieces;
+
+            auto start = bound(pair * pieces);
+            auto a = src + start;
+            auto m = bound(pair * pieces + width) - start;
+            auto b = a + m;
+            auto total = bound(pair * pieces + pieces) - start;
+
+            auto k0 = piece * total / pieces;
+            auto k1 = (piece + 1) * total / pieces;
+            auto i0 = co_rank(k0, a, m, b, total - m, less);
+            auto i1 = co_rank(k1, a, m, b, total - m, less);
+
+            merge(a + i0, i1 - i0, b + (k0 - i0), (k1 - i1) - (k0 - i0), dst + start + k0, less);
+        });
+
+        swap(src, dst);
+    }
+
+    if (src != items.data)
+        memcpy(items.data, src, n * sizeof(T));
+}
+
+template <typename T>
+auto parallel_sort(ptr<Arena> arena, Container<T> items, usize threads) -> void {
+    parallel_sort(arena, items, threads, [](ref<T> a, ref<T> b) { return a < b; });
+}
+
+// Minimal io_uring submission and completion rings, fd < 0 when unavailable
+struct Ring {
+    int fd;
+    u32 entries;
+    u32 tail;
+    ptr<u32> sq_tail;
+    ptr<u32> sq_mask;
+    ptr<u32> sq_array;
+    ptr<io_uring_sqe> sqes;
+    ptr<u32> cq_head;
+    ptr<u32> cq_tail;
+    ptr<u32> cq_mask;
+    ptr<io_uring_cqe> cqes;
+    ptr<void> sq_map;
+    usize sq_size;
+    ptr<void> cq_map;
+    usize cq_size;
+    usize sqes_size;
+
+    static auto create(u32 entries) -> Ring {
+        auto ring = Ring {};
+        ring.fd = -1;
+
+        if (entries == 0)
+            return ring;
+
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        auto fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+
+        if (fd < 0)
+            return ring;
+
+        ring.sq_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+        ring.cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            if (ring.cq_size > ring.sq_size)
+                ring.sq_size = ring.cq_size;
+
+            ring.cq_size = 0;
+        }
+
+        ring.sq_map = mmap(NULL, ring.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        assert(ring.sq_map != MAP_FAILED);
+
+        ring.cq_map = ring.sq_map;
+
+        if (ring.cq_size != 0) {
+            ring.cq_map = mmap(NULL, ring.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            assert(ring.cq_map != MAP_FAILED);
+        }
+
+        ring.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        ring.sqes = static_cast<ptr<io_uring_sqe>>(
+            mmap(NULL, ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        assert(ring.sqes != MAP_FAILED);
+
+        auto sq = static_cast<ptr<char>>(ring.sq_map);
+        auto cq = static_cast<ptr<char>>(ring.cq_map);
+
+        ring.fd = fd;
+        ring.entries = params.sq_entries;
+        ring.sq_tail = reinterpret_cast<ptr<u32>>(sq + params.sq_off.tail);
+        ring.sq_mask = reinterpret_cast<ptr<u32>>(sq + params.sq_off.ring_mask);
+        ring.sq_array = reinterpret_cast<ptr<u32>>(sq + params.sq_off.array);
+        ring.cq_head = reinterpret_cast<ptr<u32>>(cq + params.cq_off.head);
+        ring.cq_tail = reinterpret_cast<ptr<u32>>(cq + params.cq_off.tail);
+        ring.cq_mask = reinterpret_cast<ptr<u32>>(cq + params.cq_off.ring_mask);
+        ring.cqes = reinterpret_cast<ptr<io_uring_cqe>>(cq + params.cq_off.cqes);
+        ring.tail = *ring.sq_tail;
+
+        return ring;
+    }
+
+    auto destroy() -> void {
+        if (fd < 0)
+            return;
+
+        munmap(sqes, sqes_size);
+
+        if (cq_map != sq_map)
+            munmap(cq_map, cq_size);
+
+        munmap(sq_map, sq_size);
+        close(fd);
+    }
+
+    auto sqe() -> ptr<io_uring_sqe> {
+        auto index = tail++ & *sq_mask;
+
+        sq_array[index] = index;
+        memset(&sqes[index], 0, sizeof(io_uring_sqe));
+
+        return &sqes[index];
+    }
+
+    auto supports(u8 op) -> bool {
+        alignas(8) buf<u8, sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op)> bytes = {};
+        auto probe = reinterpret_cast<ptr<io_uring_probe>>(bytes);
+
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+            return false;
+
+        return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+    }
+
+    auto enter(u32 submit, u32 wait) -> void {
+        __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+        // The kernel only takes entries still pending in the ring, so an
+        // interrupted call can be repeated as is
+        while (syscall(__NR_io_uring_enter, fd, submit, wait, IORING_ENTER_GETEVENTS, NULL, 0) < 0)
+            assert(errno == EINTR);
+    }
+
+    // Keeps up to entries operations in flight until all n completed,
+    // prepare(i, sqe) fills operation i and complete(i, res) consumes it
+    template <typename P, typename C>
+    auto run(usize n, P prepare, C complete) -> void {
+        usize submitted = 0;
+        usize completed = 0;
+
+        while (completed < n) {
+            u32 queued = 0;
+
+            while (submitted < n && submitted - completed < entries) {
+                auto s = sqe();
+                prepare(submitted, s);
+                s->user_data = submitted++;
+                ++queued;
+            }
+
+            enter(queued, 1);
+
+            auto head = *cq_head;
+
+            while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+                auto cqe = &cqes[head++ & *cq_mask];
+
+                complete(static_cast<usize>(cqe->user_data), cqe->res);
+                ++completed;
+            }
+
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+};
+
+// Reads until n bytes or end of file, returns the new offset or -errno
+auto read_all(int fd, ptr<char> buffer, usize n, usize offset) -> i64 {
+    while (offset < n) {
+        auto r = pread(fd, buffer + offset, n - offset, static_cast<off_t>(offset));
+
+        if (r < 0 && errno == EINTR)
+            continue;
+
+        if (r < 0)
+            return -errno;
+
+        if (r == 0)
+            break;
+
+        offset += static_cast<usize>(r);
+    }
+
+    return static_cast<i64>(offset);
+}
+
+// Loads many files at once, through io_uring when the kernel allows it and
+// otherwise with pread on a pool of threads; contents land in the arena.
+// Files go through open, statx, read and close one window at a time so at
+// most window descriptors are open
+struct File_Loader {
+    ptr<Arena> arena;
+    Ring ring;
+    usize threads;
+    usize window;
+
+    static auto create(ptr<Arena> arena, u32 depth = 256) -> File_Loader {
+        auto ring = Ring::create(depth);
+
+        if (ring.fd >= 0) {
+            auto usable = ring.supports(IORING_OP_OPENAT) && ring.supports(IORING_OP_STATX)
+                && ring.supports(IORING_OP_READ) && ring.supports(IORING_OP_CLOSE);
+
+            if (!usable) {
+                ring.destroy();
+                ring.fd = -1;
+            }
+        }
+
+        auto threads = cpu_count() < 64 ? cpu_count() : 64;
+
+        return { arena, ring, threads, ring.fd >= 0 ? usize(ring.entries) : usize(256) };
+    }
+
+    auto destroy() -> void {
+        ring.destroy();
+    }
+
+    // callback(index, contents, error) runs on the calling thread, error is
+    // 0 or the errno that stopped that file and contents is then empty
+    template <typename F>
+    auto load(Container<String> paths, F callback) -> void {
+        auto n = paths.tail;
+
+        usize bytes = n * (sizeof(ptr<imm<char>>) + 16)
+            + window * (sizeof(int) * 2 + sizeof(usize) + sizeof(ptr<char>) + sizeof(struct statx) + 64);
+
+        for (auto it: paths)
+            bytes += it.length + 1;
+
+        auto scratch = Arena::create(bytes);
+        defer cleanup = [&scratch](){ scratch.destroy(); };
+
+        auto names = scratch.allocate<ptr<imm<char>>>(n);
+        auto fds = scratch.allocate<int>(window);
+        auto errors = scratch.allocate<int>(window);
+        auto sizes = scratch.allocate<usize>(window);
+        auto buffers = scratch.allocate<ptr<char>>(window);
+        auto stats = scratch.allocate<struct statx>(window);
+
+        for (usize i = 0; i < n; ++i)
+            names[i] = paths[i].cstr(&scratch);
+
+        for (usize base = 0; base < n; base += window) {
+            auto count = n - base < window ? n - base : window;
+
+            for (usize i = 0; i < count; ++i) {
+                fds[i] = -1;
+                errors[i] = 0;
+                buffers[i] = nullptr;
+                sizes[i] = 0;
+            }
+
+            if (ring.fd < 0)
+                load_pooled(names + base, count, fds, errors, sizes, buffers, stats);
+            else
+                load_ring(names + base, count, fds, errors, sizes, buffers, stats);
+
+            for (usize i = 0; i < count; ++i)
+                callback(base + i, String::create(buffers[i], sizes[i]), errors[i]);
+        }
+    }
+
+    auto load_pooled(ptr<ptr<imm<char>>> names, usize count, ptr<int> fds, ptr<int> errors,
+                     ptr<usize> sizes, ptr<ptr<char>> buffers, ptr<struct statx> stats) -> void {
+        auto workers = threads < count ? threads : count;
+
+        parallel(workers, [&](usize k) {
+            for (auto i = k; i < count; i += workers) {
+                fds[i] = open(names[i], O_RDONLY | O_CLOEXEC);
+
+                if (fds[i] < 0)
+                    errors[i] = errno;
+                else if (statx(fds[i], "", AT_EMPTY_PATH, STATX_SIZE, &stats[i]) != 0)
+                    errors[i] = errno;
+            }
+        });
+
+        for (usize i = 0; i < count; ++i)
+            if (errors[i] == 0)
+                buffers[i] = arena->allocate<char>(stats[i].stx_size);
+
+        parallel(workers, [&](usize k) {
+            for (auto i = k; i < count; i += workers) {
+                if (errors[i] == 0) {
+                    auto r = read_all(fds[i], buffers[i], stats[i].stx_size, 0);
+
+                    if (r < 0)
+                        errors[i] = static_cast<int>(-r);
+                    else
+                        sizes[i] = static_cast<usize>(r);
+                }
+
+                if (fds[i] >= 0)
+                    close(fds[i]);
+            }
+        });
+    }
+
+    // Failed files are given no-ops in the later stages
+    auto load_ring(ptr<ptr<imm<char>>> names, usize count, ptr<int> fds, ptr<int> errors,
+                   ptr<usize> sizes, ptr<ptr<char>> buffers, ptr<struct statx> stats) -> void {
+        ring.run(count, [&](usize i, ptr<io_uring_sqe> sqe) {
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<u64>(names[i]);
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        }, [&](usize i, i32 res) {
+            if (res < 0)
+                errors[i] = -res;
+            else
+                fds[i] = res;
+        });
+
+        ring.run(count, [&](usize i, ptr<io_uring_sqe> sqe) {
+            if (errors[i] != 0)
+                return;
+
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = fds[i];
+            sqe->addr = reinterpret_cast<u64>("");
+            sqe->len = STATX_SIZE;
+            sqe->off = reinterpret_cast<u64>(&stats[i]);
+            sqe->statx_flags = AT_EMPTY_PATH;
+        }, [&](usize i, i32 res) {
+            if (res < 0)
+                errors[i] = -res;
+        });
+
+        for (usize i = 0; i < count; ++i)
+            if (errors[i] == 0)
+                buffers[i] = arena->allocate<char>(stats[i].stx_size);
+
+        ring.run(count, [&](usize i, ptr<io_uring_sqe> sqe) {
+            if (errors[i] != 0)
+                return;
+
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fds[i];
+            sqe->addr = reinterpret_cast<u64>(buffers[i]);
+            sqe->len = static_cast<u32>(stats[i].stx_size < (1u << 30) ? stats[i].stx_size : (1u << 30));
+        }, [&](usize i, i32 res) {
+            if (errors[i] != 0)
+                return;
+
+            if (res < 0) {
+                errors[i] = -res;
+                return;
+            }
+
+            // Short reads are rare on regular files, finish them in place
+            auto r = read_all(fds[i], buffers[i], stats[i].stx_size, static_cast<usize>(res));
+
+            if (r < 0)
+                errors[i] = static_cast<int>(-r);
+            else
+                sizes[i] = static_cast<usize>(r);
+        });
+
+        ring.run(count, [&](usize i, ptr<io_uring_sqe> sqe) {
+            if (fds[i] < 0)
+                return;
+
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = fds[i];
+        }, [&](usize, i32) {});
+    }
+
+    // Files that failed to load are left as String { nullptr, 0 }
+    auto load(Container<String> paths) -> Vector<String> {
+        auto files = Vector<String>::create(arena, paths.tail);
+        files.tail = paths.tail;
+
+        load(paths, [&files](usize i, String contents, int error) {
+            files[i] = error == 0 ? contents : String::create(nullptr, 0);
+        });
+
+        return files;
+    }
+};
+
+// Read-only mapping of a whole file, released with unmap_file
+auto map_file(String path) -> String {
+    auto scratch = Arena::create(path.length + 1);
+    defer cleanup = [&scratch](){ scratch.destroy(); };
+
+    auto fd = open(path.cstr(&scratch), O_RDONLY);
+    assert(fd >= 0);
+
+    struct stat info;
+    assert(fstat(fd, &info) == 0);
+
+    auto length = static_cast<usize>(info.st_size);
+    auto data = length == 0 ? nullptr : mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    assert(data != MAP_FAILED);
+
+    close(fd);
+
+    return { static_cast<ptr<imm<char>>>(data), length };
+}
+
+auto unmap_file(String file) -> void {
+    if (file.length > 0)
+        munmap(const_cast<ptr<char>>(file.data), file.length);
+}
+
+auto write_file(String path, String contents) -> void {
+    auto scratch = Arena::create(path.length + 1);
+    defer cleanup = [&scratch](){ scratch.destroy(); };
+
+    auto fd = open(path.cstr(&scratch), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0);
+
+    for (usize n = 0; n < contents.length;) {
+        auto w = write(fd, contents.data + n, contents.length - n);
+        assert(w > 0);
+        n += static_cast<usize>(w);
+    }
+
+    close(fd);
+}
+
+struct Arena_Options {
+    static constexpr usize huge_page = 2 << 20;
+
+    // Transparent huge pages through MADV_HUGEPAGE
+    bool huge_pages;
+    // Reserved MAP_HUGETLB pages, tried before transparent ones
+    bool explicit_huge_pages;
+    // Bind to this NUMA node, or -1 to leave placement alone
+    i32 node;
+    // Touch every page from the calling thread so first-touch places it
+    bool prefault;
+
+    static auto create() -> Arena_Options {
+        return { true, false, -1, false };
+    }
+};
+
+// Whether MADV_HUGEPAGE can take effect, the kernel still decides page by page
+auto transparent_huge_pages() -> bool {
+    auto fd = ::open("/sys/kernel/mm/transparent_hugepage/enabled", O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return false;
+
+    buf<char, 64> text = {};
+    auto n = read(fd, text, sizeof(text) - 1);
+
+    close(fd);
+
+    auto mode = String::create(text);
+
+    return n > 0 && mode.find(String::create("[never]")) == mode.length;
+}
+
+// Arena on an anonymous mapping; every option falls back to plain pages
+// when the kernel or machine cannot provide it, obtained tells what was
+// actually set up
+auto map_arena(usize n, Arena_Options options, ptr<Arena_Options> obtained = nullptr) -> Arena {
+    auto length = n;
+    ptr<void> memory = MAP_FAILED;
+    auto got = Arena_Options { false, false, -1, options.prefault };
+
+    if (options.huge_pages || options.explicit_huge_pages)
+        length = (n + Arena_Options::huge_page - 1) / Arena_Options::huge_page * Arena_Options::huge_page;
+
+    if (options.explicit_huge_pages)
+        memory = mmap(NULL, length, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+
+    got.explicit_huge_pages = memory != MAP_FAILED;
+
+    if (memory == MAP_FAILED && options.huge_pages) {
+        // Over-map and trim so the arena starts on a huge page boundary
+        auto raw = static_cast<ptr<char>>(mmap(NULL, length + Arena_Options::huge_page,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        assert(raw != MAP_FAILED);
+
+        auto address = reinterpret_cast<usize>(raw);
+        auto aligned = raw + (Arena_Options::huge_page - address % Arena_Options::huge_page) % Arena_Options::huge_page;
+
+        if (aligned != raw)
+            munmap(raw, static_cast<usize>(aligned - raw));
+
+        munmap(aligned + length, static_cast<usize>(raw + Arena_Options::huge_page - aligned));
+
+        memory = aligned;
+        got.huge_pages = madvise(memory, length, MADV_HUGEPAGE) == 0 && transparent_huge_pages();
+    }
+
+    if (memory == MAP_FAILED) {
+        memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        assert(memory != MAP_FAILED);
+    }
+
+    if (options.node >= 0 && options.node < 64) {
+        auto mask = u64(1) << options.node;
+
+        // Fails without NUMA support or for a missing node, placement then stays default
+        if (syscall(__NR_mbind, memory, length, MPOL_BIND, &mask, 64, 0) == 0)
+            got.node = options.node;
+    }
+
+    if (options.prefault) {
+        auto page = static_cast<usize>(sysconf(_SC_PAGESIZE));
+
+        for (usize i = 0; i < length; i += page)
+            static_cast<ptr<volatile char>>(memory)[i] = 0;
+    }
+
+    auto release = [](ptr<void> m, usize size) {
+        munmap(m, size);
+    };
+
+    if (obtained != nullptr)
+        *obtained = got;
+
+    return { length, 0, memory, release };
+}
+
+struct Arena_Image {
+    static constexpr u64 signature = 0x616e657261636973;
+
+    u64 magic;
+    u64 base;
+    u64 position;
+    u64 root;
+};
+
+// Arena living in a shared file mapping; it reopens at the address it was
+// saved from when that range is free, so String and Vector pointers stay
+// valid with no work. Otherwise delta is set and callers fix their
+// pointers once before use (Packer avoids this with relative offsets)
+struct Arena_File {
+    static constexpr usize default_base = 0x600000000000;
+
+    Arena arena;
+    ptr<Arena_Image> image;
+    i64 delta;
+
+    static auto map(int fd, usize n, usize base) -> ptr<void> {
+        auto memory = mmap(reinterpret_cast<ptr<void>>(base), n, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+
+        // Older kernels treat the flag as a hint and may map elsewhere
+        if (memory != MAP_FAILED && memory != reinterpret_cast<ptr<void>>(base)) {
+            munmap(memory, n);
+            memory = MAP_FAILED;
+        }
+
+        if (memory == MAP_FAILED)
+            memory = mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        assert(memory != MAP_FAILED);
+
+        return memory;
+    }
+
+    static auto from(int fd, usize n, usize base) -> Arena_File {
+        auto memory = map(fd, n, base);
+
+        close(fd);
+
+        auto release = [](ptr<void> m, usize size) {
+            munmap(m, size);
+        };
+
+        auto file = Arena_File { { n, 0, memory, release }, static_cast<ptr<Arena_Image>>(memory), 0 };
+
+        file.delta = static_cast<i64>(reinterpret_cast<usize>(memory) - base);
+
+        return file;
+    }
+
+    static auto create(String path, usize n, usize base = default_base) -> Arena_File {
+        auto scratch = Arena::create(path.length + 1);
+        defer cleanup = [&scratch](){ scratch.destroy(); };
+
+        auto fd = ::open(path.cstr(&scratch), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        assert(fd >= 0);
+        assert(ftruncate(fd, static_cast<off_t>(n)) == 0);
+
+        auto file = from(fd, n, base);
+
+        file.arena.make<Arena_Image>(Arena_Image::signature, reinterpret_cast<usize>(file.arena.memory), u64(0), u64(0));
+        file.image->position = file.arena.position;
+        file.delta = 0;
+
+        return file;
+    }
+
+    static auto open(String path) -> Arena_File {
+        auto scratch = Arena::create(path.length + 1);
+        defer cleanup = [&scratch](){ scratch.destroy(); };
+
+        auto fd = ::open(path.cstr(&scratch), O_RDWR);
+        assert(fd >= 0);
+
+        struct stat info;
+        assert(fstat(fd, &info) == 0);
+
+        Arena_Image saved;
+        assert(pread(fd, &saved, sizeof(saved), 0) == sizeof(saved));
+        assert(saved.magic == Arena_Image::signature);
+
+        auto file = from(fd, static_cast<usize>(info.st_size), saved.base);
+
+        file.arena.position = saved.position;
+
+        return file;
+    }
+
+    // Records where data ends and what the root object is, then flushes
+    template <typename T>
+    auto save(ptr<T> root) -> void {
+        image->base = reinterpret_cast<usize>(arena.memory);
+        image->position = arena.position;
+        image->root = static_cast<u64>(reinterpret_cast<ptr<char>>(root) - static_cast<ptr<char>>(arena.memory));
+        delta = 0;
+
+        assert(msync(arena.memory, arena.capacity, MS_SYNC) == 0);
+    }
+
+    template <typename T>
+    auto root() -> ptr<T> {
+        assert(image->root != 0);
+
+        return reinterpret_cast<ptr<T>>(static_cast<ptr<char>>(arena.memory) + image->root);
+    }
+
+    // Moves a pointer saved at the old base into the current mapping. Call
+    // it once per pointer: when the old and new ranges overlap a moved
+    // pointer can look like a saved one and would be moved again
+    template <typename T>
+    auto fix(ref<ptr<T>> pointer) -> void {
+        auto address = reinterpret_cast<usize>(pointer);
+
+        if (delta != 0 && address >= image->base && address < image->base + arena.capacity)
+            pointer = reinterpret_cast<ptr<T>>(address + static_cast<usize>(delta));
+    }
+
+    auto fix(ref<String> string) -> void {
+        fix(string.data);
+    }
+
+    template <typename T>
+    auto fix(ref<Vector<T>> vector) -> void {
+        fix(vector.data);
+    }
+
+    auto destroy() -> void {
+        arena.destroy();
+    }
+};
+
+auto now_ms() -> u64 {
+    timespec ts;
+    assert(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+
+    return static_cast<u64>(ts.tv_sec) * 1000 + static_cast<u64>(ts.tv_nsec) / 1000000;
+}
+
+struct Event_Loop;
+
+// Socket or pipe driven by an Event_Loop. Input lines are handed out as
+// views into the read buffer, valid until on_line returns. Output is
+// gathered as segments and flushed with a single writev per round. When the
+// peer falls behind and the buffers fill up, write and send return false
+// and on_drain runs once everything queued has gone out
+struct Connection {
+    static constexpr usize buffer_size = 16 << 10;
+
+    int fd;
+    bool closing;
+    bool waiting_output;
+    bool dirty;
+    usize start;
+    usize end;
+    usize scanned;
+    ptr<Event_Loop> loop;
+    ptr<Connection> next_dirty;
+    ptr<Connection> next_closed;
+    ptr<void> user;
+    func<void, ptr<Connection>, String> on_line;
+    func<void, ptr<Connection>> on_close;
+    func<void, ptr<Connection>> on_drain;
+    func<void, ptr<Event_Loop>, int> on_accept;
+    Arena output_arena;
+    String_Builder output;
+    Array<String, 64> segments;
+    buf<char, buffer_size> input;
+    buf<char, buffer_size> storage;
+
+    auto mark() -> void;
+
+    // Copies string into the connection's output buffer, strings longer
+    // than buffer_size never fit and have to go through send
+    auto write(String string) -> bool {
+        if (segments.tail == segments.size() || output_arena.position + string.length > output_arena.capacity)
+            flush();
+
+        if (output_arena.position + string.length > output_arena.capacity)
+            return false;
+
+        auto copy = output.end;
+        auto last = segments.tail > 0 ? &segments[segments.tail - 1] : nullptr;
+
+        if (last != nullptr && last->data + last->length == copy) {
+            last->length += string.length;
+        } else {
+            if (segments.tail == segments.size())
+                return false;
+
+            segments.append({ copy, string.length });
+        }
+
+        output.push(string);
+        mark();
+
+        return true;
+    }
+
+    // Queues string without copying, it must stay alive until flushed
+    auto send(String string) -> bool {
+        if (segments.tail == segments.size())
+            flush();
+
+        if (segments.tail == segments.size())
+            return false;
+
+        segments.append(string);
+        mark();
+
+        return true;
+    }
+
+    auto pending() -> bool {
+        return segments.tail > 0;
+    }
+
+    auto watch(bool output_ready) -> void;
+
+    // Returns true once everything queued has been written
+    auto flush() -> bool {
+        while (segments.tail > 0) {
+            buf<iovec, 64> vectors;
+
+            for (usize i = 0; i < segments.tail; ++i)
+                vectors[i] = { const_cast<ptr<char>>(segments[i].data), segments[i].length };
+
+            auto n = writev(fd, vectors, static_cast<int>(segments.tail));
+
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    watch(true);
+                    return false;
+                }
+
+                closing = true;
+                segments.tail = 0;
+                mark();
+                break;
+            }
+
+            auto sent = static_cast<usize>(n);
+            usize done = 0;
+
+            while (done < segments.tail && segments[done].length <= sent) {
+                sent -= segments[done].length;
+                ++done;
+            }
+
+            if (done < segments.tail)
+                segments[done] = segments[done].chop_left(sent);
+
+            for (usize i = done; i < segments.tail; ++i)
+                segments[i - done] = segments[i];
+
+            segments.tail -= done;
+        }
+
+        output_arena.position = 0;
+        output = String_Builder::create(&output_arena);
+
+        if (waiting_output)
+            watch(false);
+
+        return true;
+    }
+
+    // Reads what is available and passes on every complete line
+    auto receive() -> void {
+        for (;;) {
+            if (end == buffer_size) {
+                if (start == 0) {
+                    // Line longer than the whole buffer
+                    closing = true;
+                    return;
+                }
+
+                memmove(input, input + start, end - start);
+                end -= start;
+                scanned -= start;
+                start = 0;
+            }
+
+            auto n = read(fd, input + end, buffer_size - end);
+
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return;
+
+            if (n <= 0) {
+                if (start < end && !closing)
+                    on_line(this, { input + start, end - start });
+
+                start = end = scanned = 0;
+                closing = true;
+                return;
+            }
+
+            end += static_cast<usize>(n);
+
+            for (; scanned < end && !closing; ++scanned) {
+                if (input[scanned] == '\n') {
+                    on_line(this, { input + start, scanned - start });
+                    start = scanned + 1;
+                }
+            }
+
+            if (start == end)
+                start = end = scanned = 0;
+        }
+    }
+};
+
+struct Timer {
+    u64 deadline;
+    u64 id;
+    func<void, ptr<Event_Loop>, ptr<void>> callback;
+    ptr<void> user;
+};
+
+// Single threaded epoll loop over connections, listeners and timers
+struct Event_Loop {
+    int epoll;
+    bool running;
+    Pool<Connection> connections;
+    usize open;
+    ptr<Connection> dirty;
+    ptr<Connection> closed;
+    ptr<Timer> timers;
+    usize timer_count;
+    usize timer_capacity;
+    u64 timer_id;
+    ptr<void> user;
+
+    static auto create(ptr<Arena> arena, usize max_timers = 64) -> Event_Loop {
+        auto loop = Event_Loop {};
+
+        loop.epoll = epoll_create1(EPOLL_CLOEXEC);
+        assert(loop.epoll >= 0);
+
+        // Writes to a vanished peer fail with EPIPE instead of killing us
+        signal(SIGPIPE, SIG_IGN);
+
+        loop.connections = Pool<Connection>::create(arena, 4);
+        loop.timers = arena->allocate<Timer>(max_timers);
+        loop.timer_capacity = max_timers;
+
+        return loop;
+    }
+
+    auto destroy() -> void {
+        close(epoll);
+    }
+
+    auto add(int fd, func<void, ptr<Connection>, String> on_line, func<void, ptr<Connection>> on_close = nullptr, ptr<void> user_data = nullptr) -> ptr<Connection> {
+        assert(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0);
+
+        auto connection = connections.make();
+
+        connection->fd = fd;
+        connection->loop = this;
+        connection->user = user_data;
+        connection->on_line = on_line;
+        connection->on_close = on_close;
+        connection->output_arena = { Connection::buffer_size, 0, connection->storage, nullptr };
+        connection->output = String_Builder::create(&connection->output_arena);
+
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = connection;
+
+        assert(epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) == 0);
+
+        ++open;
+
+        return connection;
+    }
+
+    // on_accept receives each new client socket
+    auto listen(int fd, func<void, ptr<Event_Loop>, int> on_accept, ptr<void> user_data = nullptr) -> ptr<Connection> {
+        auto listener = add(fd, nullptr, nullptr, user_data);
+        listener->on_accept = on_accept;
+        return listener;
+    }
+
+    auto shut(ptr<Connection> connection) -> void {
+        connection->closing = true;
+        connection->mark();
+    }
+
+    auto after(u64 ms, func<void, ptr<Event_Loop>, ptr<void>> callback, ptr<void> user_data = nullptr) -> u64 {
+        assert(timer_count < timer_capacity);
+
+        auto i = timer_count++;
+        timers[i] = { now_ms() + ms, ++timer_id, callback, user_data };
+
+        sift_up(i);
+
+        return timer_id;
+    }
+
+    auto cancel(u64 id) -> bool {
+        for (usize i = 0; i < timer_count; ++i) {
+            if (timers[i].id != id)
+                continue;
+
+            timers[i] = timers[--timer_count];
+
+            if (i < timer_count) {
+                sift_up(i);
+                sift_down(i);
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    auto sift_up(usize i) -> void {
+        for (; i > 0 && timers[i].deadline < timers[(i - 1) / 2].deadline; i = (i - 1) / 2)
+            swap(timers[i], timers[(i - 1) / 2]);
+    }
+
+    auto sift_down(usize i) -> void {
+        for (auto child = 2 * i + 1; child < timer_count; child = 2 * i + 1) {
+            if (child + 1 < timer_count && timers[child + 1].deadline < timers[child].deadline)
+                ++child;
+
+            if (timers[i].deadline <= timers[child].deadline)
+                return;
+
+            swap(timers[i], timers[child]);
+            i = child;
+        }
+    }
+
+    auto fire() -> void {
+        auto now = now_ms();
+
+        while (timer_count > 0 && timers[0].deadline <= now) {
+            auto timer = timers[0];
+
+            timers[0] = timers[--timer_count];
+            sift_down(0);
+
+            timer.callback(this, timer.user);
+        }
+    }
+
+    // Flushes dirty output and releases connections closed this round
+    auto settle() -> void {
+        while (dirty != nullptr) {
+            auto it = dirty;
+            dirty = it->next_dirty;
+
+            // Still flagged while flushing, so a failed write doesn't queue it again
+            if (it->pending())
+                it->flush();
+
+            it->dirty = false;
+
+            // A closing connection stays open until its output drains
+            if (it->closing && !it->pending()) {
+                it->next_closed = closed;
+                closed = it;
+            }
+        }
+
+        for (auto it = closed; it != nullptr; it = closed) {
+            closed = it->next_closed;
+
+            if (it->on_close != nullptr)
+                it->on_close(it);
+
+            epoll_ctl(epoll, EPOLL_CTL_DEL, it->fd, NULL);
+            close(it->fd);
+            --open;
+
+            connections.release(it);
+        }
+    }
+
+    auto run_once(i32 timeout) -> void {
+        if (timer_count > 0) {
+            auto now = now_ms();
+            auto wait = timers[0].deadline > now ? static_cast<i32>(timers[0].deadline - now) : 0;
+
+            if (timeout < 0 || wait < timeout)
+                timeout = wait;
+        }
+
+        buf<epoll_event, 64> events;
+
+        auto n = epoll_wait(epoll, events, 64, timeout);
+
+        assert(n >= 0 || errno == EINTR);
+
+        for (i32 i = 0; i < n; ++i) {
+            auto connection = static_cast<ptr<Connection>>(events[i].data.ptr);
+
+            if (connection->closing) {
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                    connection->segments.tail = 0;
+                else if (events[i].events & EPOLLOUT)
+                    connection->flush();
+
+                if (!connection->pending())
+                    connection->mark();
+
+                continue;
+            }
+
+            if (connection->on_accept != nullptr) {
+                for (;;) {
+                    auto client = accept4(connection->fd, NULL, NULL, SOCK_CLOEXEC);
+
+                    if (client < 0)
+                        break;
+
+                    connection->on_accept(this, client);
+                }
+
+                continue;
+            }
+
+            if ((events[i].events & EPOLLOUT) && connection->flush() && connection->on_drain != nullptr)
+                connection->on_drain(connection);
+
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                connection->receive();
+
+            if (connection->closing)
+                connection->mark();
+        }
+
+        fire();
+        settle();
+    }
+
+    // Runs until stop() or until there is nothing left to wait for
+    auto run() -> void {
+        running = true;
+
+        while (running && (open > 0 || timer_count > 0))
+            run_once(-1);
+    }
+
+    auto stop() -> void {
+        running = false;
+    }
+};
+
+auto Connection::mark() -> void {
+    if (dirty)
+        return;
+
+    dirty = true;
+    next_dirty = loop->dirty;
+    loop->dirty = this;
+}
+
+auto Connection::watch(bool output_ready) -> void {
+    epoll_event event = {};
+    // Closing connections only wait for their output to drain
+    event.events = (closing ? u32(0) : u32(EPOLLIN)) | (output_ready ? u32(EPOLLOUT) : u32(0));
+    event.data.ptr = this;
+
+    assert(epoll_ctl(loop->epoll, EPOLL_CTL_MOD, fd, &event) == 0);
+
+    waiting_output = output_ready;
+}
+
+struct Command_Result {
+    usize id;
+    i32 status;
+    String out;
+    String err;
+};
+
+struct Output_Chunk {
+    ptr<Output_Chunk> next;
+    usize used;
+    buf<char, 4096> data;
+};
+
+struct Output_Stream {
+    int fd;
+    ptr<Output_Chunk> head;
+    ptr<Output_Chunk> tail;
+};
+
+struct Running_Process {
+    usize id;
+    pid_t pid;
+    Output_Stream out;
+    Output_Stream err;
+};
+
+struct Completion {
+    Command_Result result;
+    ptr<Completion> next;
+};
+
+// Runs commands with posix_spawn, up to limit at a time, capturing stdout
+// and stderr through pipes polled together. Finished commands are queued
+// in completion order with their output copied into the arena, commands
+// that cannot be started finish with status 127 and the reason in err
+struct Process_Pool {
+    static constexpr usize max_running = 64;
+
+    ptr<Arena> arena;
+    usize limit;
+    usize next_id;
+    Pool<Output_Chunk> chunks;
+    Array<Running_Process, max_running> running;
+    Pool<Completion> completions;
+    ptr<Completion> first;
+    ptr<Completion> last;
+
+    static auto create(ptr<Arena> arena, usize limit) -> Process_Pool {
+        assert(limit > 0 && limit <= max_running);
+
+        auto pool = Process_Pool {};
+
+        pool.arena = arena;
+        pool.limit = limit;
+        pool.chunks = Pool<Output_Chunk>::create(arena, 16);
+        pool.completions = Pool<Completion>::create(arena, 16);
+
+        return pool;
+    }
+
+    // Waits for a free slot first when limit commands are already running
+    auto spawn(Container<ptr<imm<char>>> argv) -> usize {
+        while (running.tail >= limit)
+            pump(-1);
+
+        // args only lives until posix_spawnp returns; the position is rewound
+        // before anything that must outlive the call is allocated
+        auto mark = arena->position;
+        auto args = arena->allocate<ptr<char>>(argv.tail + 1);
+
+        for (usize i = 0; i < argv.tail; ++i)
+            args[i] = const_cast<ptr<char>>(argv[i]);
+
+        args[argv.tail] = nullptr;
+
+        buf<int, 2> out;
+        buf<int, 2> err;
+
+        if (pipe2(out, O_CLOEXEC) != 0) {
+            auto error = errno;
+            arena->position = mark;
+            return fail(argv[0], error);
+        }
+
+        if (pipe2(err, O_CLOEXEC) != 0) {
+            auto error = errno;
+            close(out[0]);
+            close(out[1]);
+            arena->position = mark;
+            return fail(argv[0], error);
+        }
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, err[1], STDERR_FILENO);
+
+        pid_t pid;
+        auto spawned = posix_spawnp(&pid, args[0], &actions, NULL, args, environ);
+
+        posix_spawn_file_actions_destroy(&actions);
+        close(out[1]);
+        close(err[1]);
+
+        arena->position = mark;
+
+        if (spawned != 0) {
+            close(out[0]);
+            close(err[0]);
+            return fail(argv[0], spawned);
+        }
+
+        running.append({ next_id, pid, { out[0], nullptr, nullptr }, { err[0], nullptr, nullptr } });
+
+        return next_id++;
+    }
+
+    template <typename ...A>
+    auto spawn(A... args) -> usize {
+        auto argv = make_array<ptr<imm<char>>>(args...);
+        return spawn(argv.view());
+    }
+
+    auto finish(Command_Result result) -> void {
+        auto node = completions.make(result, nullptr);
+
+        if (last != nullptr)
+            last->next = node;
+        else
+            first = node;
+
+        last = node;
+    }
+
+    auto fail(ptr<imm<char>> command, int error) -> usize {
+        auto message = String::create("%s: %s\n").format(arena, command, strerror(error));
+
+        finish({ next_id, 127, String::create(""), message });
+
+        return next_id++;
+    }
+
+    auto collect(ref<Output_Stream> stream) -> void {
+        if (stream.tail == nullptr || stream.tail->used == sizeof(stream.tail->data)) {
+            auto chunk = chunks.make();
+
+            if (stream.tail != nullptr)
+                stream.tail->next = chunk;
+            else
+                stream.head = chunk;
+
+            stream.tail = chunk;
+        }
+
+        auto n = read(stream.fd, stream.tail->data + stream.tail->used, sizeof(stream.tail->data) - stream.tail->used);
+
+        if (n > 0) {
+            stream.tail->used += static_cast<usize>(n);
+        } else if (n == 0 || errno != EINTR) {
+            close(stream.fd);
+            stream.fd = -1;
+        }
+    }
+
+    auto gather(ref<Output_Stream> stream) -> String {
+        auto builder = String_Builder::create(arena);
+
+        for (auto it = stream.head; it != nullptr;) {
+            builder.push({ it->data, it->used });
+
+            auto next = it->next;
+            chunks.release(it);
+            it = next;
+        }
+
+        return builder.result;
+    }
+
+    // Reads whatever output is ready and retires commands whose pipes closed
+    auto pump(i32 timeout) -> void {
+        buf<pollfd, max_running * 2> fds;
+        buf<ptr<Output_Stream>, max_running * 2> streams;
+        usize n = 0;
+
+        for (auto &it: running) {
+            for (auto stream: make_array<ptr<Output_Stream>>(&it.out, &it.err)) {
+                if (stream->fd < 0)
+                    continue;
+
+                fds[n] = { stream->fd, POLLIN, 0 };
+                streams[n++] = stream;
+            }
+        }
+
+        if (n > 0 && poll(fds, n, timeout) > 0)
+            for (usize i = 0; i < n; ++i)
+                if (fds[i].revents != 0)
+                    collect(*streams[i]);
+
+        for (usize i = 0; i < running.tail;) {
+            auto &it = running[i];
+
+            if (it.out.fd >= 0 || it.err.fd >= 0) {
+                ++i;
+                continue;
+            }
+
+            int status;
+            assert(waitpid(it.pid, &status, 0) == it.pid);
+
+            finish({
+                it.id,
+                WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status),
+                gather(it.out),
+                gather(it.err),
+            });
+
+            running[i] = running[--running.tail];
+        }
+    }
+
+    auto ready() -> bool {
+        return first != nullptr;
+    }
+
+    auto busy() -> bool {
+        return running.tail > 0 || ready();
+    }
+
+    // Next finished command, in completion order
+    auto wait() -> Command_Result {
+        assert(busy());
+
+        while (!ready())
+            pump(-1);
+
+        auto node = first;
+        auto result = node->result;
+
+        first = node->next;
+
+        if (first == nullptr)
+            last = nullptr;
+
+        completions.release(node);
+
+        return result;
+    }
+};
+
+// Runs one command to completion and returns its status and output
+template <typename ...A>
+auto run_process(ptr<Arena> arena, A... args) -> Command_Result {
+    auto pool = Process_Pool::create(arena, 1);
+
+    pool.spawn(args...);
+
+    return pool.wait();
+}
@@ -1,8 +1,11 @@
 #include "basic.cc"
+#include "os.cc"
 #include "test.cc"
+#include "test_os.cc"
 
 auto main() -> int {
     test_all();
+    test_os_all();
 
     println("ok");
 
@@ -107,6 +107,151 @@ auto test_queue() -> void {
     assert(s.head == 1);
 }
 
+auto test_soa_vector(ptr<Arena> arena) -> void {
+    auto records = Soa_Vector<i32, f64, u8>::create(arena, 4);
+
+    records.append(1, 1.5, 'a');
+    records.append(2, 2.5, 'b');
+    records.append(3, 3.5, 'c');
+
+    assert(records.tail == 3);
+    assert(records.get<0>(1) == 2);
+    assert(records.get<1>(2) == 3.5);
+    assert(records.get<2>(0) == 'a');
+
+    i32 sum = 0;
+
+    for (auto it: records.view<0>())
+        sum += it;
+
+    assert(sum == 6);
+
+    auto prices = records.view<1>();
+
+    assert(prices.tail == 3);
+    assert(prices[1] == 2.5);
+    assert(reinterpret_cast<usize>(records.column<1>()) % alignof(f64) == 0);
+}
+
+auto test_bits(ptr<Arena> arena) -> void {
+    auto mask = Bitset<130>::create();
+
+    mask.set(0);
+    mask.set(64);
+    mask.set(129);
+
+    assert(mask.test(64));
+    assert(!mask.test(63));
+    assert(mask.count() == 3);
+
+    auto other = Bitset<130>::create();
+    other.set(64);
+    other.set(100);
+
+    auto both = mask;
+    both &= other;
+    assert(both.count() == 1);
+
+    auto either = mask;
+    either |= other;
+    assert(either.count() == 4);
+
+    auto only = mask;
+    only.andnot(other);
+    assert(only.count() == 2);
+    assert(!only.test(64));
+
+    auto positions = Vector<usize>::create(arena, 4);
+
+    for (auto it: either.ones())
+        positions.append(it);
+
+    assert(positions.tail == 4);
+    assert(positions[1] == 64);
+    assert(positions[2] == 100);
+    assert(positions[3] == 129);
+
+    auto bits = Bit_Vector::create(arena, 2000);
+
+    for (usize i = 0; i < 2000; i += 3)
+        bits.set(i);
+
+    auto inverse = bits;
+    inverse.words = arena->allocate<u64>(bits.size());
+    memcpy(reinterpret_cast<ptr<char>>(inverse.words), reinterpret_cast<ptr<imm<char>>>(bits.words), bits.size() * sizeof(u64));
+    inverse.flip();
+
+    assert(bits.count() == 667);
+    assert(inverse.count() == 2000 - 667);
+
+    auto index = Rank_Index::create(arena, bits);
+
+    assert(index.total == 667);
+    assert(index.rank(0) == 0);
+    assert(index.rank(1) == 1);
+    assert(index.rank(3) == 1);
+    assert(index.rank(1999) == 667);
+
+    for (usize k = 0; k < 667; ++k) {
+        assert(index.select(k) == k * 3);
+        assert(index.rank(k * 3) == k);
+    }
+
+    auto empty = Bit_Vector::create(arena, 0);
+
+    for (auto it: empty.ones()) {
+        (void) it;
+        assert(false);
+    }
+
+    assert(Rank_Index::create(arena, empty).total == 0);
+}
+
+auto test_pool(ptr<Arena> arena) -> void {
+    struct Node {
+        i32 key;
+        i32 value;
+    };
+
+    auto pool = Pool<Node>::create(arena, 4);
+
+    auto a = pool.make(1, 2);
+    auto b = pool.make(3, 4);
+
+    assert(a->key == 1);
+    assert(b->value == 4);
+    assert(b == a + 1);
+
+    auto position = arena->position;
+
+    pool.release(a);
+    auto c = pool.make(5, 6);
+    assert(c == a);
+    assert(c->key == 5);
+
+    pool.make();
+    pool.make();
+    assert(arena->position == position);
+
+    pool.make();
+    assert(arena->position > position);
+
+    auto cache = Pool_Cache<Node>::create(&pool, 2);
+
+    auto d = cache.make(7, 8);
+    assert(d->key == 7);
+
+    cache.release(d);
+    cache.release(pool.make());
+    cache.release(pool.make());
+    assert(cache.count == 2);
+
+    cache.destroy();
+    assert(cache.count == 0);
+    assert(cache.free == nullptr);
+    assert(pool.free != nullptr);
+}
+
 auto test_string(ptr<Arena> arena) -> void {
     assert(String::create("Hello,").append(arena, String::create("World!")) == "Hello,World!");
 
@@ -139,6 +284,440 @@ auto test_string(ptr<Arena> arena) -> void {
     assert(res == "Hello, World!");
 }
 
+auto test_csv(ptr<Arena> arena) -> void {
+    i64 i;
+    f64 f;
+
+    assert(String::create("-42").to_i64(&i) && i == -42);
+    assert(!String::create("4x").to_i64(&i));
+    assert(String::create("9223372036854775807").to_i64(&i) && i == 9223372036854775807ll);
+    assert(String::create("-9223372036854775808").to_i64(&i) && i == -9223372036854775807ll - 1);
+    assert(!String::create("9223372036854775808").to_i64(&i));
+    assert(!String::create("18446744073709551617").to_i64(&i));
+    assert(String::create("2.5e2").to_f64(&f) && f == 250.0);
+    assert(String::create("-0.125").to_f64(&f) && f == -0.125);
+    assert(!String::create(".").to_f64(&f));
+
+    auto text = String::create(
+        "id,price,name\r\n"
+        "1,2.5,plain\r\n"
+        "\r\n"
+        "2,3,\"with, comma\"\n"
+        "3,-1,\"say \"\"hi\"\"\"\n"
+        "4\n");
+
+    auto table = Csv_Table::create(arena, text, Csv_Options::create());
+
+    assert(table.rows == 4);
+    assert(table.columns[0].name == "id");
+    assert(table.columns[2].name == "name");
+    assert(table.columns[0].type == Csv_Type::integer);
+    assert(table.columns[1].type == Csv_Type::real);
+    assert(table.columns[2].type == Csv_Type::text);
+
+    auto ids = table.column<i64>(0);
+    auto prices = table.column<f64>(1);
+    auto names = table.column<String>(2);
+
+    assert(ids[3] == 4);
+    assert(prices[1] == 3.0);
+    assert(prices[3] == 0.0);
+    assert(names[0] == "plain");
+    assert(names[1] == "with, comma");
+    assert(names[2] == "say \"hi\"");
+    assert(names[3] == "");
+
+    auto options = Csv_Options::create();
+    options.header = false;
+    options.separator = ';';
+
+    auto types = make_array<Csv_Type>(Csv_Type::text, Csv_Type::integer);
+    auto raw = Csv_Table::create(arena, String::create("1;2\n3;4"), options, types.view());
+
+    assert(raw.rows == 2);
+    assert(raw.column<String>(0)[1] == "3");
+    assert(raw.column<i64>(1)[1] == 4);
+
+    // Empty last field without a trailing newline, quoted numbers
+    auto tail = Csv_Table::create(arena, String::create("a,b\n1,\"2\"\n3,"), Csv_Options::create());
+
+    assert(tail.rows == 2);
+    assert(tail.columns[1].type == Csv_Type::integer);
+    assert(tail.column<i64>(1)[0] == 2);
+    assert(tail.column<i64>(1)[1] == 0);
+
+    assert(String::create("1e999999999999").to_f64(&f) && f > 1e308);
+    assert(String::create("1e99999999999999999999").to_f64(&f) && f > 1e308);
+    assert(String::create("1e-99999999999999999999").to_f64(&f) && f == 0.0);
+    assert(String::create("1e-999999999999").to_f64(&f) && f == 0.0);
+    assert(!String::create("1e").to_f64(&f));
+    assert(!String::create("1e+").to_f64(&f));
+
+    // Integers that don't fit in i64 make the column real instead
+    auto wide = Csv_Table::create(arena, String::create("n\n1\n18446744073709551617\n"), Csv_Options::create());
+
+    assert(wide.columns[0].type == Csv_Type::real);
+    assert(wide.column<f64>(0)[1] > 1.8e19);
+}
+
+auto test_sort(ptr<Arena> arena) -> void {
+    auto numbers = Vector<i32>::create(arena, 300);
+
+    for (i32 i = 0; i < 300; ++i)
+        numbers.append((i * 7919) % 301 - 150);
+
+    auto copy = Vector<i32>::create(arena, 300);
+
+    for (auto it: numbers)
+        copy.append(it);
+
+    sort(numbers.view());
+    radix_sort(arena, copy.view());
+
+    for (usize i = 1; i < 300; ++i)
+        assert(numbers[i - 1] <= numbers[i]);
+
+    for (usize i = 0; i < 300; ++i)
+        assert(numbers[i] == copy[i]);
+
+    sort(numbers.view(), [](i32 a, i32 b) { return a > b; });
+    assert(numbers[0] == 150);
+
+    auto position = arena->position;
+
+    auto keys = make_array<u64>(u64(1) << 40, u64(3), u64(0), u64(1) << 63, u64(3));
+    radix_sort(arena, keys.view());
+
+    assert(arena->position == position);
+    assert(keys[0] == 0);
+    assert(keys[2] == 3);
+    assert(keys[4] == u64(1) << 63);
+
+    auto sorted = make_array<i32>(1, 3, 3, 5, 8);
+
+    assert(lower_bound(sorted.view(), 3) == 1);
+    assert(lower_bound(sorted.view(), 4) == 3);
+    assert(lower_bound(sorted.view(), 9) == 5);
+
+    for (i32 i = 0; i < 10; ++i)
+        assert(lower_bound_branchless(sorted.view(), i) == lower_bound(sorted.view(), i));
+
+    auto words = String::create("pear apple fig apple banana a pea peach").split(arena, ' ');
+
+    radix_sort(arena, words.view());
+
+    assert(words[0] == "a");
+    assert(words[1] == "apple");
+    assert(words[3] == "banana");
+    assert(words[5] == "pea");
+    assert(words[7] == "pear");
+
+    radix_sort(arena, Vector<u32>::create(arena, 1).view());
+    radix_sort(arena, Vector<String>::create(arena, 1).view());
+
+    // Long shared prefixes, and staircases that split off one string per byte
+    auto chars = arena->allocate<char>(20001);
+    memset(chars, 'x', 20000);
+    chars[20000] = 'a';
+
+    auto deep = Vector<String>::create(arena, 400);
+
+    for (usize i = 0; i < 200; ++i) {
+        deep.append({ chars + 20000 - (i * 37) % 200, (i * 37) % 200 + 1 });
+        deep.append({ chars, 20000 - i });
+    }
+
+    radix_sort(arena, deep.view());
+
+    for (usize i = 1; i < deep.tail; ++i)
+        assert(!(deep[i] < deep[i - 1]));
+
+    assert(String::create("ab").compare(String::create("abc")) < 0);
+    assert(!(String::create("b") < String::create("abc")));
+}
+
+struct Packed_Record {
+    u32 id;
+    f64 score;
+    Packed_String name;
+    Packed_Vector<i32> values;
+    Packed_Vector<Packed_String> tags;
+};
+
+auto pack_record(ptr<Arena> arena) -> String {
+    auto packer = Packer::create(arena);
+
+    auto record = packer.make<Packed_Record>();
+    record->id = 7;
+    record->score = 0.5;
+
+    packer.store(record->name, String::create("seven"));
+    packer.store(record->values, make_array<i32>(1, 2, 3).view());
+
+    auto tags = packer.store(record->tags, 2);
+    packer.store(tags[0], String::create("odd"));
+    packer.store(tags[1], String::create("prime"));
+
+    return packer.finish(record);
+}
+
+auto test_pack(ptr<Arena> arena) -> void {
+    auto buffer = pack_record(arena);
+
+    // Relative offsets survive a move to any suitably aligned address
+    arena->position += (16 - reinterpret_cast<usize>(arena->end()) % 16) % 16;
+    auto copy = arena->allocate<char>(buffer.length);
+    memcpy(copy, buffer.data, buffer.length);
+
+    auto record = unpack<Packed_Record>(String::create(copy, buffer.length));
+
+    assert(record->id == 7);
+    assert(record->score == 0.5);
+    assert(record->name.view() == "seven");
+    assert(record->values.length == 3);
+    assert(record->values[2] == 3);
+    assert(record->tags[0].view() == "odd");
+    assert(record->tags[1].view() == "prime");
+
+    i32 sum = 0;
+
+    for (auto it: record->values)
+        sum += it;
+
+    assert(sum == 6);
+}
+
+struct Counter {
+    i32 current;
+    i32 last;
+
+    auto next(ptr<i32> out) -> bool {
+        if (current > last)
+            return false;
+
+        *out = current++;
+
+        return true;
+    }
+};
+
+auto test_range(ptr<Arena> arena) -> void {
+    auto numbers = make_array<i32>(1, 2, 3, 4, 5, 6, 7, 8);
+
+    auto squares = range(numbers.view())
+        .filter([](i32 n) { return n % 2 == 0; })
+        .map([](i32 n) { return static_cast<i64>(n) * n; })
+        .take(3)
+        .collect(arena);
+
+    assert(squares.tail == 3);
+    assert(squares[0] == 4);
+    assert(squares[2] == 36);
+
+    auto sum = range(numbers.view()).skip(6).fold(0, [](i32 a, i32 b) { return a + b; });
+    assert(sum == 15);
+
+    assert(range(numbers.view()).take(0).count() == 0);
+
+    auto lengths = range(String::create("a,bb,,dddd"), ',')
+        .map([](String s) { return s.length; })
+        .collect(arena);
+
+    auto split = String::create("a,bb,,dddd").split(arena, ',');
+
+    assert(lengths.tail == split.tail);
+
+    for (usize i = 0; i < split.tail; ++i)
+        assert(lengths[i] == split[i].length);
+
+    auto counter = Counter { 1, 100 };
+
+    auto evens = range<i32>(&counter)
+        .filter([](i32 n) { return n % 2 == 0; })
+        .take(5)
+        .count();
+
+    assert(evens == 5);
+    assert(counter.current == 11);
+}
+
+auto test_cache(ptr<Arena> arena) -> void {
+    auto cache = Cache<i32>::create(arena, 2, 16);
+
+    assert(cache.get(String::create("a")) == nullptr);
+    assert(cache.misses == 1);
+
+    cache.put(String::create("a"), 1);
+    cache.put(String::create("b"), 2);
+
+    assert(*cache.get(String::create("a")) == 1);
+    assert(cache.hits == 1);
+
+    // b was not referenced since insertion, so it goes first
+    cache.put(String::create("c"), 3);
+
+    assert(cache.evictions == 1);
+    assert(cache.count == 2);
+    assert(cache.get(String::create("b")) == nullptr);
+    assert(*cache.get(String::create("c")) == 3);
+    assert(*cache.get(String::create("a")) == 1);
+
+    cache.put(String::create("c"), 4);
+    assert(*cache.get(String::create("c")) == 4);
+    assert(cache.count == 2);
+
+    assert(cache.remove(String::create("a")));
+    assert(!cache.remove(String::create("a")));
+    assert(cache.count == 1);
+
+    i32 loads = 0;
+    auto load = [&loads]() { return ++loads * 10; };
+
+    assert(cache.fetch(String::create("d"), load) == 10);
+    assert(cache.fetch(String::create("d"), load) == 10);
+    assert(loads == 1);
+
+    // Oversized keys are served but not kept
+    auto long_key = String::create("a much longer key than sixteen bytes");
+
+    assert(cache.put(long_key, 5) == nullptr);
+    assert(cache.fetch(long_key, load) == 20);
+    assert(cache.fetch(long_key, load) == 30);
+
+    // String values live in the cache's own slots
+    auto files = Cache<String>::create(arena, 2, 16, 8);
+    buf<char, 8> source = { 'c', 'o', 'n', 't', 'e', 'n', 't', 's' };
+
+    files.put(String::create("a"), { source, 8 });
+    source[0] = 'X';
+
+    assert(*files.get(String::create("a")) == "contents");
+    assert(files.put(String::create("b"), String::create("too long here")) == nullptr);
+
+    // c reuses the slot of b, which was never referenced
+    auto slot = files.put(String::create("b"), String::create("bb"))->data;
+
+    files.put(String::create("c"), String::create("cc"));
+
+    assert(files.get(String::create("b")) == nullptr);
+    assert(*files.get(String::create("a")) == "contents");
+    assert(*files.get(String::create("c")) == "cc");
+    assert(files.get(String::create("c"))->data == slot);
+
+    auto sharded = Sharded_Cache<i32, 4>::create(arena, 8, 16);
+
+    assert(sharded.fetch(String::create("x"), load) == 40);
+    assert(sharded.fetch(String::create("x"), load) == 40);
+    assert(sharded.hits() == 1);
+    assert(sharded.misses() == 1);
+
+    auto texts = Sharded_Cache<String, 2>::create(arena, 4, 16, 16);
+
+    texts.put(String::create("k"), String::create("value"));
+
+    String copied;
+
+    assert(texts.get(String::create("k"), &copied, arena));
+    assert(copied == "value");
+
+    auto text_load = []() { return String::create("loaded"); };
+
+    assert(texts.fetch(String::create("j"), text_load, arena) == "loaded");
+    assert(texts.fetch(String::create("j"), text_load, arena) == "loaded");
+    assert(texts.hits() == 2);
+}
+
+auto test_matcher(ptr<Arena> arena) -> void {
+    auto cc = Matcher::glob(arena, String::create("*.cc"));
+
+    assert(cc.match(String::create("basic.cc")));
+    assert(cc.match(String::create(".cc")));
+    assert(!cc.match(String::create("basic.cc.orig")));
+    assert(!cc.match(String::create("basic.c")));
+
+    auto tests = Matcher::glob(arena, String::create("src/*/test_?.{cc,h}"));
+
+    assert(tests.prefix == "src/");
+    assert(tests.match(String::create("src/lib/test_a.cc")));
+    assert(tests.match(String::create("src/a/b/test_z.h")));
+    assert(!tests.match(String::create("src/lib/test_ab.cc")));
+    assert(!tests.match(String::create("lib/test_a.cc")));
+
+    auto hidden = Matcher::glob(arena, String::create("[!.]*"));
+
+    assert(hidden.match(String::create("notes")));
+    assert(!hidden.match(String::create(".git")));
+
+    auto error = Matcher::regex(arena, String::create("error: \\d+ (files?|dirs)"));
+
+    assert(error.prefix == "error: ");
+    assert(error.match(String::create("build: error: 12 files missing")));
+    assert(error.match(String::create("error: 1 file")));
+    assert(error.match(String::create("error: 3 dirs")));
+    assert(!error.match(String::create("error: x files")));
+    assert(!error.match(String::create("warning: 2 files")));
+
+    auto word = Matcher::regex(arena, String::create("^fo+(bar|baz)*$"));
+
+    assert(word.anchored_start);
+    assert(word.match(String::create("foo")));
+    assert(word.match(String::create("foobarbaz")));
+    assert(!word.match(String::create("foobarbaz!")));
+    assert(!word.match(String::create("xfoo")));
+
+    auto any = Matcher::regex(arena, String::create("a.c|[x-z]\\w"));
+
+    assert(any.prefix.length == 0);
+    assert(any.match(String::create("__abc__")));
+    assert(any.match(String::create("y_")));
+    assert(!any.match(String::create("ac")));
+
+    assert(Matcher::regex(arena, String::create("")).match(String::create("anything")));
+
+    // Empty matches at the start, anchors inside alternation
+    assert(Matcher::regex(arena, String::create("^a*")).match(String::create("b")));
+    assert(Matcher::regex(arena, String::create("^(ab|c)*")).match(String::create("c")));
+
+    auto either_end = Matcher::regex(arena, String::create("a|b$"));
+
+    assert(!either_end.anchored_start);
+    assert(either_end.match(String::create("ax")));
+    assert(either_end.match(String::create("xb")));
+    assert(!either_end.match(String::create("bx")));
+
+    auto either_start = Matcher::regex(arena, String::create("^a|b"));
+
+    assert(either_start.match(String::create("xb")));
+    assert(either_start.match(String::create("ax")));
+    assert(!either_start.match(String::create("xa")));
+    assert(Matcher::regex(arena, String::create("(^a|b)c")).match(String::create("xbc")));
+    assert(!Matcher::regex(arena, String::create("(^a|b)c")).match(String::create("xac")));
+    assert(Matcher::regex(arena, String::create("x\\$")).match(String::create("ax$b")));
+    assert(Matcher::regex(arena, String::create("a$b*$")).match(String::create("ba")));
+    assert(Matcher::regex(arena, String::create("^$")).match(String::create("")));
+
+    // Patterns whose DFA blows up fail instead of aborting
+    auto builder = String_Builder::create(arena);
+    builder.push(String::create("(a|b)*a"));
+
+    for (usize i = 0; i < 13; ++i)
+        builder.push(String::create("(a|b)"));
+
+    assert(!Matcher::regex(arena, builder.result).valid());
+
+    // Malformed patterns are reported the same way
+    for (auto it: make_array<ptr<imm<char>>>("(", "(a", "a)", "[a", "[", "\\", "*a", "a|+", "(?)"))
+        assert(!Matcher::regex(arena, String::create(it)).valid());
+
+    for (auto it: make_array<ptr<imm<char>>>("{a,b", "{", "[a", "[!", "a\\"))
+        assert(!Matcher::glob(arena, String::create(it)).valid());
+
+    assert(Matcher::glob(arena, String::create("*a}")).match(String::create("xa}")));
+    assert(Matcher::regex(arena, String::create("[]a]")).match(String::create("]")));
+    assert(String::create("hello").find(String::create("llo")) == 2);
+    assert(String::create("hello").find(String::create("x")) == 5);
+}
+
 auto test_defer_aux(ptr<Array<i32, 2>> arr) -> void {
     defer second = [&arr](){ arr->append(2); };
     defer first = [&arr](){ arr->append(1); };
@@ -155,14 +734,23 @@ auto test_defer() -> void {
 }
 
 auto test_all() -> void {
-    auto arena = Arena::create(2048);
+    auto arena = Arena::create(65536);
     defer cleanup = [&arena](){ arena.destroy(); };
 
     test_arena(&arena);
     test_vector(&arena);
+    test_soa_vector(&arena);
     test_array();
     test_stack();
     test_queue();
+    test_pool(&arena);
+    test_bits(&arena);
     test_string(&arena);
+    test_csv(&arena);
+    test_sort(&arena);
+    test_pack(&arena);
+    test_range(&arena);
+    test_cache(&arena);
+    test_matcher(&arena);
     test_defer();
 }
@@ -0,0 +1,628 @@
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+
+auto test_parallel() -> void {
+    auto hits = Array<usize, 4>::create();
+
+    parallel(4, [&hits](usize k) {
+        hits[k] = k + 1;
+    });
+
+    assert(hits[0] == 1);
+    assert(hits[3] == 4);
+}
+
+auto test_csv_parallel(ptr<Arena> arena) -> void {
+    auto builder = String_Builder::create(arena);
+
+    builder.push(String::create("id,note\n"));
+
+    for (i32 i = 0; i < 2000; ++i)
+        builder.push(String::create(i % 7 == 0 ? "7,\"a\nb,\"\"c\"\"\"\n" : "1,plain\n"));
+
+    auto text = builder.result;
+
+    auto serial = Csv_Table::create(arena, text, Csv_Options::create());
+    auto table = csv_parallel(arena, text, Csv_Options::create(), 4);
+
+    assert(table.rows == 2000);
+    assert(serial.rows == 2000);
+
+    auto ids = table.column<i64>(0);
+    auto notes = table.column<String>(1);
+
+    for (usize i = 0; i < table.rows; ++i) {
+        assert(ids[i] == serial.column<i64>(0)[i]);
+        assert(notes[i] == serial.column<String>(1)[i]);
+    }
+
+    assert(notes[7] == "a\nb,\"c\"");
+
+    assert(csv_parallel(arena, text, Csv_Options::create(), 0).rows == 2000);
+}
+
+auto test_parallel_sort(ptr<Arena> arena) -> void {
+    auto numbers = Vector<u32>::create(arena, 50000);
+
+    u32 state = 12345;
+
+    for (usize i = 0; i < numbers.size(); ++i) {
+        state = state * 1664525 + 1013904223;
+        numbers.append(state >> 8);
+    }
+
+    auto position = arena->position;
+
+    parallel_sort(arena, numbers.view(), 4);
+
+    assert(arena->position == position);
+
+    for (usize i = 1; i < numbers.tail; ++i)
+        assert(numbers[i - 1] <= numbers[i]);
+}
+
+auto test_file_loader(ptr<Arena> arena) -> void {
+    auto paths = make_array<String>(String::create("basic.cc"), String::create("test.cc"), String::create("os.cc"));
+
+    auto loader = File_Loader::create(arena);
+    defer cleanup = [&loader](){ loader.destroy(); };
+
+    auto files = loader.load(paths.view());
+
+    assert(files.tail == 3);
+
+    for (usize i = 0; i < files.tail; ++i)
+        assert(files[i] == String::from_file(arena, paths[i]));
+
+    // Thread pool fallback
+    auto pooled = File_Loader::create(arena, 0);
+
+    assert(pooled.ring.fd < 0);
+
+    usize seen = 0;
+
+    pooled.load(paths.view(), [&](usize i, String contents, int error) {
+        assert(error == 0);
+        assert(contents == files[i]);
+        ++seen;
+    });
+
+    assert(seen == 3);
+
+    // Small windows and per file errors, on both paths
+    auto many = Vector<String>::create(arena, 10);
+
+    for (usize i = 0; i < 10; ++i)
+        many.append(i == 7 ? String::create("missing.txt") : paths[i % 3]);
+
+    for (u32 depth: make_array<u32>(4u, 0u)) {
+        auto small = File_Loader::create(arena, depth);
+        defer done = [&small](){ small.destroy(); };
+
+        small.window = 4;
+
+        auto loaded = small.load(many.view());
+
+        for (usize i = 0; i < 10; ++i) {
+            if (i == 7)
+                assert(loaded[i].data == nullptr);
+            else
+                assert(loaded[i] == files[i % 3]);
+        }
+    }
+
+    // A signal without SA_RESTART interrupts the ring's blocking wait
+    struct sigaction action = {};
+    action.sa_handler = [](int) {};
+    assert(sigaction(SIGALRM, &action, NULL) == 0);
+
+    itimerval timer = { { 0, 5000 }, { 0, 5000 } };
+    assert(setitimer(ITIMER_REAL, &timer, NULL) == 0);
+
+    __kernel_timespec wait = { 0, 50000000 };
+    i32 result = 0;
+
+    loader.ring.run(1, [&](usize, ptr<io_uring_sqe> sqe) {
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->addr = reinterpret_cast<u64>(&wait);
+        sqe->len = 1;
+    }, [&](usize, i32 res) {
+        result = res;
+    });
+
+    assert(result == -ETIME);
+
+    timer = {};
+    assert(setitimer(ITIMER_REAL, &timer, NULL) == 0);
+    signal(SIGALRM, SIG_DFL);
+}
+
+auto test_map_file(ptr<Arena> arena) -> void {
+    auto path = String::create("/tmp/basic_test_pack.bin");
+
+    write_file(path, pack_record(arena));
+
+    auto file = map_file(path);
+    defer cleanup = [&file](){ unmap_file(file); };
+
+    auto record = unpack<Packed_Record>(file);
+
+    assert(record->name.view() == "seven");
+    assert(record->tags[1].view() == "prime");
+
+    unlink("/tmp/basic_test_pack.bin");
+}
+
+auto test_shared_arena() -> void {
+    static constexpr usize threads = 4;
+    static constexpr usize n = 20000;
+
+    auto shared = Shared_Arena::create(8 << 20, 4096);
+    defer cleanup = [&shared](){ shared.destroy(); };
+
+    buf<ptr<ptr<u64>>, threads> results;
+
+    parallel(threads, [&](usize k) {
+        auto local = Local_Arena::create(&shared);
+
+        results[k] = local.allocate<ptr<u64>>(n);
+
+        for (usize i = 0; i < n; ++i)
+            results[k][i] = local.make<u64>(k * n + i);
+
+        auto large = local.allocate<char>(10000);
+        memset(large, 0, 10000);
+    });
+
+    for (usize k = 0; k < threads; ++k)
+        for (usize i = 0; i < n; ++i)
+            assert(*results[k][i] == k * n + i);
+
+    assert(shared.arena.position <= shared.arena.capacity);
+
+    for (usize i = 0; i < 8; ++i) {
+        auto chunk = shared.grab(i * 24 + 1);
+        assert(reinterpret_cast<usize>(chunk.memory) % 64 == 0);
+    }
+}
+
+auto test_map_arena() -> void {
+    auto options = Arena_Options::create();
+    options.explicit_huge_pages = true;
+    options.node = 0;
+    options.prefault = true;
+
+    Arena_Options backing;
+    auto arena = map_arena(3 << 20, options, &backing);
+    defer cleanup = [&arena](){ arena.destroy(); };
+
+    // Whatever the machine gave, it is one of these
+    assert(!(backing.explicit_huge_pages && backing.huge_pages));
+    assert(backing.node == -1 || backing.node == 0);
+    assert(backing.prefault);
+
+    assert(arena.capacity >= 3 << 20);
+    assert(arena.release != nullptr);
+    assert(reinterpret_cast<usize>(arena.memory) % Arena_Options::huge_page == 0);
+
+    auto values = arena.allocate<u64>(1000);
+
+    for (usize i = 0; i < 1000; ++i)
+        values[i] = i;
+
+    assert(values[999] == 999);
+
+    auto plain = Arena_Options::create();
+    plain.huge_pages = false;
+
+    auto small = map_arena(100, plain, &backing);
+    assert(small.capacity == 100);
+    assert(!backing.huge_pages && !backing.explicit_huge_pages && backing.node == -1);
+    small.destroy();
+}
+
+struct Index {
+    String name;
+    Vector<String> words;
+};
+
+// Fixes every saved pointer once, a no-op when the file mapped at its base
+auto check_index(ref<Arena_File> file) -> void {
+    auto index = file.root<Index>();
+
+    file.fix(index->name);
+    file.fix(index->words);
+
+    for (auto &it: index->words)
+        file.fix(it);
+
+    assert(index->name == "fruits");
+    assert(index->words[0] == "apple");
+    assert(index->words[2] == "fig");
+}
+
+auto test_arena_file() -> void {
+    auto path = String::create("/tmp/basic_test_arena.bin");
+    auto base = Arena_File::default_base + (usize(1) << 32);
+
+    // The requested base is only a preference, sanitizers or other
+    // mappings may already hold it
+    {
+        auto file = Arena_File::create(path, 1 << 20, base);
+
+        assert(file.delta == 0);
+
+        auto index = file.arena.make<Index>();
+        index->name = String::create("fruit").append(&file.arena, String::create("s"));
+        index->words = String::create("apple pear fig").split(&file.arena, ' ');
+
+        file.save(index);
+        base = file.image->base;
+        file.destroy();
+    }
+
+    {
+        auto file = Arena_File::open(path);
+        defer cleanup = [&file](){ file.destroy(); };
+
+        check_index(file);
+    }
+
+    // Occupy the saved range so the next open has to relocate
+    auto blocker = mmap(reinterpret_cast<ptr<void>>(base), 4096, PROT_READ,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    assert(blocker != MAP_FAILED);
+
+    {
+        auto file = Arena_File::open(path);
+        defer cleanup = [&file](){ file.destroy(); };
+
+        if (blocker == reinterpret_cast<ptr<void>>(base))
+            assert(file.delta != 0);
+
+        check_index(file);
+
+        auto extra = file.arena.make<i32>(5);
+        assert(*extra == 5);
+    }
+
+    munmap(blocker, 4096);
+    unlink("/tmp/basic_test_arena.bin");
+}
+
+auto test_sharded_cache(ptr<Arena> arena) -> void {
+    auto cache = Sharded_Cache<usize, 8>::create(arena, 256, 32);
+    auto keys = String::create("k0 k1 k2 k3 k4 k5 k6 k7 k8 k9").split(arena, ' ');
+
+    parallel(4, [&](usize) {
+        for (usize i = 0; i < 10000; ++i) {
+            auto n = i % keys.tail;
+            assert(cache.fetch(keys[n], [n]() { return n; }) == n);
+        }
+    });
+
+    assert(cache.hits() + cache.misses() == 40000);
+    assert(cache.evictions() == 0);
+}
+
+struct Echo_State {
+    usize lines;
+    usize closed;
+    usize stop_after;
+    bool timer_fired;
+};
+
+auto echo_line(ptr<Connection> connection, String line) -> void {
+    auto state = static_cast<ptr<Echo_State>>(connection->loop->user);
+
+    connection->write(String::create("> "));
+    connection->write(line);
+    connection->send(String::create("\n"));
+
+    if (++state->lines == state->stop_after)
+        connection->loop->stop();
+}
+
+auto echo_close(ptr<Connection> connection) -> void {
+    ++static_cast<ptr<Echo_State>>(connection->loop->user)->closed;
+}
+
+auto read_exactly(int fd, ptr<Arena> arena, usize n) -> String {
+    auto data = arena->allocate<char>(n);
+
+    for (usize got = 0; got < n;) {
+        auto r = read(fd, data + got, n - got);
+        assert(r > 0);
+        got += static_cast<usize>(r);
+    }
+
+    return { data, n };
+}
+
+auto test_event_loop_socketpair(ptr<Arena> arena) -> void {
+    auto state = Echo_State { 0, 0, 2, false };
+
+    auto loop = Event_Loop::create(arena);
+    defer cleanup = [&loop](){ loop.destroy(); };
+    loop.user = &state;
+
+    buf<int, 2> fds;
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    loop.add(fds[0], echo_line, echo_close);
+
+    assert(write(fds[1], "hello\nwor", 9) == 9);
+    assert(write(fds[1], "ld\n", 3) == 3);
+
+    loop.run();
+
+    assert(state.lines == 2);
+    assert(read_exactly(fds[1], arena, 16) == "> hello\n> world\n");
+
+    // The unterminated tail is delivered when the peer closes
+    state.stop_after = 0;
+    assert(write(fds[1], "bye", 3) == 3);
+    close(fds[1]);
+
+    loop.run();
+
+    assert(state.lines == 3);
+    assert(state.closed == 1);
+    assert(loop.open == 0);
+}
+
+auto test_event_loop_shut_from_timer(ptr<Arena> arena) -> void {
+    auto state = Echo_State { 0, 0, 0, false };
+
+    auto loop = Event_Loop::create(arena);
+    defer cleanup = [&loop](){ loop.destroy(); };
+    loop.user = &state;
+
+    buf<int, 2> fds;
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    defer close_peer = [&fds](){ close(fds[1]); };
+
+    auto idle = loop.add(fds[0], echo_line, echo_close);
+
+    // Nothing arrives on the socket, so only the shut itself can settle it
+    loop.after(10, [](ptr<Event_Loop> l, ptr<void> c) {
+        l->shut(static_cast<ptr<Connection>>(c));
+    }, idle);
+
+    loop.run();
+
+    assert(state.closed == 1);
+    assert(loop.open == 0);
+}
+
+auto test_event_loop_loopback(ptr<Arena> arena) -> void {
+    auto state = Echo_State { 0, 0, 0, false };
+
+    auto loop = Event_Loop::create(arena);
+    defer cleanup = [&loop](){ loop.destroy(); };
+    loop.user = &state;
+
+    auto server = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    assert(server >= 0);
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    auto length = static_cast<socklen_t>(sizeof(address));
+
+    assert(bind(server, reinterpret_cast<ptr<sockaddr>>(&address), length) == 0);
+    assert(listen(server, 16) == 0);
+    assert(getsockname(server, reinterpret_cast<ptr<sockaddr>>(&address), &length) == 0);
+
+    auto listener = loop.listen(server, [](ptr<Event_Loop> l, int client) {
+        l->add(client, echo_line, echo_close);
+    });
+
+    auto client = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    assert(connect(client, reinterpret_cast<ptr<sockaddr>>(&address), length) == 0);
+
+    assert(write(client, "a\r\nb\n", 5) == 5);
+
+    loop.after(5000, [](ptr<Event_Loop>, ptr<void>) { assert(false); });
+
+    while (state.lines < 2)
+        loop.run_once(100);
+
+    assert(read_exactly(client, arena, 9) == "> a\r\n> b\n");
+
+    // Armed only now, a stop before run() starts would be lost
+    auto stop = loop.after(1, [](ptr<Event_Loop> l, ptr<void> s) {
+        static_cast<ptr<Echo_State>>(s)->timer_fired = true;
+        l->stop();
+    }, &state);
+
+    loop.run();
+
+    assert(state.timer_fired);
+    assert(!loop.cancel(stop));
+    assert(loop.cancel(1));
+    assert(loop.timer_count == 0);
+
+    close(client);
+    loop.shut(listener);
+
+    loop.run();
+
+    assert(state.closed == 1);
+    assert(loop.open == 0);
+}
+
+auto test_process_pool(ptr<Arena> arena) -> void {
+    auto result = run_process(arena, "sh", "-c", "echo out; echo err >&2; exit 3");
+
+    assert(result.status == 3);
+    assert(result.out == "out\n");
+    assert(result.err == "err\n");
+
+    auto large = run_process(arena, "head", "-c", "100000", "/dev/zero");
+
+    assert(large.status == 0);
+    assert(large.out.length == 100000);
+    assert(large.err.length == 0);
+
+    auto pool = Process_Pool::create(arena, 3);
+
+    buf<bool, 10> seen = {};
+
+    for (usize i = 0; i < 10; ++i) {
+        auto id = pool.spawn("sh", "-c", "echo $0", String::create("%zu").format(arena, i).cstr(arena));
+        assert(id == i);
+    }
+
+    while (pool.busy()) {
+        auto done = pool.wait();
+
+        assert(done.status == 0);
+        assert(done.out == String::create("%zu\n").format(arena, done.id));
+
+        seen[done.id] = true;
+    }
+
+    for (auto it: seen)
+        assert(it);
+
+    auto missing = run_process(arena, "definitely-not-a-command");
+
+    assert(missing.status == 127);
+    assert(missing.out.length == 0);
+    assert(missing.err == "definitely-not-a-command: No such file or directory\n");
+
+    // Failures finish right away; later spawns must not clobber their results
+    auto mixed = Process_Pool::create(arena, 2);
+
+    for (usize i = 0; i < 40; ++i) {
+        if (i % 2 == 0)
+            mixed.spawn("definitely-not-a-command");
+        else
+            mixed.spawn("sh", "-c", "printf ok");
+    }
+
+    usize failed = 0;
+
+    while (mixed.busy()) {
+        auto done = mixed.wait();
+
+        if (done.id % 2 == 0) {
+            assert(done.status == 127);
+            assert(done.err == "definitely-not-a-command: No such file or directory\n");
+            ++failed;
+        } else {
+            assert(done.status == 0);
+            assert(done.out == "ok");
+        }
+    }
+
+    assert(failed == 20);
+
+    // Results pile up without bound until they are waited for
+    auto many = Process_Pool::create(arena, 8);
+
+    for (usize i = 0; i < 300; ++i)
+        many.spawn("true");
+
+    usize finished = 0;
+
+    while (many.busy()) {
+        assert(many.wait().status == 0);
+        ++finished;
+    }
+
+    assert(finished == 300);
+}
+
+struct Slow_Reader {
+    usize queued;
+    usize refused;
+    usize drained;
+};
+
+auto queue_chunks(ptr<Connection> connection) -> void {
+    static buf<char, 4096> chunk;
+
+    auto state = static_cast<ptr<Slow_Reader>>(connection->user);
+
+    while (state->queued < 200) {
+        if (!connection->write({ chunk, sizeof(chunk) })) {
+            ++state->refused;
+            return;
+        }
+
+        ++state->queued;
+    }
+
+    connection->loop->shut(connection);
+}
+
+auto test_event_loop_backpressure(ptr<Arena> arena) -> void {
+    auto state = Slow_Reader { 0, 0, 0 };
+
+    auto loop = Event_Loop::create(arena);
+    defer cleanup = [&loop](){ loop.destroy(); };
+
+    buf<int, 2> fds;
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    assert(fcntl(fds[1], F_SETFL, O_NONBLOCK) == 0);
+
+    auto connection = loop.add(fds[0], nullptr, nullptr, &state);
+    connection->on_drain = [](ptr<Connection> c) {
+        ++static_cast<ptr<Slow_Reader>>(c->user)->drained;
+        queue_chunks(c);
+    };
+
+    // The peer is not reading yet, writes are refused instead of aborting
+    queue_chunks(connection);
+    loop.run_once(0);
+
+    assert(state.refused > 0);
+    assert(state.queued < 200);
+
+    // Shut with output pending keeps the connection until it drains
+    usize received = 0;
+    buf<char, 65536> sink;
+
+    for (;;) {
+        auto n = read(fds[1], sink, sizeof(sink));
+
+        if (n == 0)
+            break;
+
+        if (n > 0)
+            received += static_cast<usize>(n);
+
+        loop.run_once(n > 0 ? 0 : 10);
+    }
+
+    assert(state.queued == 200);
+    assert(state.drained > 0);
+    assert(received == 200 * 4096);
+    assert(loop.open == 0);
+
+    close(fds[1]);
+}
+
+auto test_os_all() -> void {
+    auto arena = Arena::create(8 << 20);
+    defer cleanup = [&arena](){ arena.destroy(); };
+
+    test_parallel();
+    test_csv_parallel(&arena);
+    test_parallel_sort(&arena);
+    test_file_loader(&arena);
+    test_map_file(&arena);
+    test_shared_arena();
+    test_map_arena();
+    test_arena_file();
+    test_sharded_cache(&arena);
+    test_event_loop_socketpair(&arena);
+    test_event_loop_backpressure(&arena);
+    test_event_loop_shut_from_timer(&arena);
+    test_event_loop_loopback(&arena);
+    test_process_pool(&arena);
+}
@@ -4,6 +4,18 @@ auto memcpy(char* dst, const char* src, size_t n) -> void {
     }
 }
 
+auto memmove(char* dst, const char* src, size_t n) -> void {
+    if (dst < src) {
+        for (size_t i = 0; i < n; ++i) {
+            dst[i] = src[i];
+        }
+    } else {
+        for (size_t i = n; i > 0; --i) {
+            dst[i - 1] = src[i - 1];
+        }
+    }
+}
+
 auto memcmp(const char* a, const char* b, size_t n) -> int {
     for (size_t i = 0; i < n; ++i) {
         if (a[i] != b[i]) {